@@ -1,663 +1,117 @@
+//2 player DX ball.  Build with
+//	g++ -O2 -mssse3 -std=c++11 -pthread -o dxball "GRAPHICS FINAL PROJEECT.cpp" game.cpp level.cpp render.cpp glstate.cpp imageloader.cpp mappedfile.cpp timing.cpp inputlog.cpp statslog.cpp bot.cpp multiball.cpp netplay.cpp spectate.cpp -lglut -lGLU -lGL
+//Run as "dxball -latency [inputs]" to measure how long inputs take to reach
+//the screen: it plays synthetic key, mouse and button events, prints the
+//latency of each kind and exits.  "dxball -bots bottom|top|both" hands
+//paddles to the computer; F2 and F3 toggle the bottom and top bots while
+//playing.  With both on it serves by itself, as an attract mode.
+//"dxball -balls n" adds n extra balls to the match (multi-ball mode); they
+//score separately, and the tally is printed at the end.  "dxball -level
+//file" plays the stages in file (see level.h) instead of the game's own;
+//its session.dxin replays only on the same stages ("dxball_sim replay
+//session.dxin file"), and is refused on any others.
+//"dxball -net bottom|top port host:port [delay ms [loss %]]" plays one
+//paddle against a dxball at host:port that plays the other (see netplay.h):
+//the bottom with the arrow keys, the top with the mouse.  The delay and loss
+//are added to every packet sent, to try it out on one machine, e.g.
+//	dxball -net bottom 7001 127.0.0.1:7002 100 5
+//	dxball -net top 7002 127.0.0.1:7001 100 5
+//"dxball -spectate port" also sends the match to spectators connecting to
+//port (see spectate.h), e.g. "dxball_sim watch 127.0.0.1:port 1000".
 #include<iostream>
 #include <stdlib.h>
 #include <GL\glut.h>
-#include <assert.h>
-#include <fstream>
+#include "game.h"
+#include "render.h"
+#include "glstate.h"
+#include "timing.h"
+#include "inputlog.h"
+#include "statslog.h"
+#include "bot.h"
+#include "multiball.h"
+#include "level.h"
+#include "netplay.h"
+#include "spectate.h"
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
 using namespace std;
 
-//Represents an image
-class Image {
-public:
-	Image(char* ps, int w, int h);
-	~Image();
-
-	/* An array of the form (R1, G1, B1, R2, G2, B2, ...) indicating the
-	* color of each pixel in image.  Color components range from 0 to 255.
-	* The array starts the bottom-left pixel, then moves right to the end
-	* of the row, then moves up to the next column, and so on.  This is the
-	* format in which OpenGL likes images.
-	*/
-	char* pixels;
-	int width;
-	int height;
-};
-//Reads a bitmap image from file.
-Image* loadBMP(const char* filename);
-
-
-Image::Image(char* ps, int w, int h) : pixels(ps), width(w), height(h) {
-
-}
-
-Image::~Image() {
-	delete[] pixels;
-}
-
-namespace {
-	//Converts a four-character array to an integer, using little-endian form
-	int toInt(const char* bytes) {
-		return (int)(((unsigned char)bytes[3] << 24) |
-			((unsigned char)bytes[2] << 16) |
-			((unsigned char)bytes[1] << 8) |
-			(unsigned char)bytes[0]);
-	}
-
-	//Converts a two-character array to a short, using little-endian form
-	short toShort(const char* bytes) {
-		return (short)(((unsigned char)bytes[1] << 8) |
-			(unsigned char)bytes[0]);
-	}
-
-	//Reads the next four bytes as an integer, using little-endian form
-	int readInt(ifstream &input) {
-		char buffer[4];
-		input.read(buffer, 4);
-		return toInt(buffer);
-	}
-
-	//Reads the next two bytes as a short, using little-endian form
-	short readShort(ifstream &input) {
-		char buffer[2];
-		input.read(buffer, 2);
-		return toShort(buffer);
-	}
-
-	//Just like auto_ptr, but for arrays
-	template<class T>
-	class auto_array {
-	private:
-		T* array;
-		mutable bool isReleased;
-	public:
-		explicit auto_array(T* array_ = NULL) :
-			array(array_), isReleased(false) {
-		}
-
-		auto_array(const auto_array<T> &aarray) {
-			array = aarray.array;
-			isReleased = aarray.isReleased;
-			aarray.isReleased = true;
-		}
-
-		~auto_array() {
-			if (!isReleased && array != NULL) {
-				delete[] array;
-			}
-		}
-
-		T* get() const {
-			return array;
-		}
-
-		T &operator*() const {
-			return *array;
-		}
-
-		void operator=(const auto_array<T> &aarray) {
-			if (!isReleased && array != NULL) {
-				delete[] array;
-			}
-			array = aarray.array;
-			isReleased = aarray.isReleased;
-			aarray.isReleased = true;
-		}
-
-		T* operator->() const {
-			return array;
-		}
-
-		T* release() {
-			isReleased = true;
-			return array;
-		}
-
-		void reset(T* array_ = NULL) {
-			if (!isReleased && array != NULL) {
-				delete[] array;
-			}
-			array = array_;
-		}
-
-		T* operator+(int i) {
-			return array + i;
-		}
-
-		T &operator[](int i) {
-			return array[i];
-		}
-	};
-}
-
-Image* loadBMP(const char* filename) {
-	ifstream input;
-	input.open(filename, ifstream::binary);
-	assert(!input.fail() || !"Could not find file");
-	char buffer[2];
-	input.read(buffer, 2);
-	assert(buffer[0] == 'B' && buffer[1] == 'M' || !"Not a bitmap file");
-	input.ignore(8);
-	int dataOffset = readInt(input);
-
-	//Read the header
-	int headerSize = readInt(input);
-	int width;
-	int height;
-	switch (headerSize) {
-	case 40:
-		//V3
-		width = readInt(input);
-		height = readInt(input);
-		input.ignore(2);
-		assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-		assert(readShort(input) == 0 || !"Image is compressed");
-		break;
-	case 12:
-		//OS/2 V1
-		width = readShort(input);
-		height = readShort(input);
-		input.ignore(2);
-		assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-		break;
-	case 64:
-		//OS/2 V2
-		assert(!"Can't load OS/2 V2 bitmaps");
-		break;
-	case 108:
-		//Windows V4
-		assert(!"Can't load Windows V4 bitmaps");
-		break;
-	case 124:
-		//Windows V5
-		assert(!"Can't load Windows V5 bitmaps");
-		break;
+const double TICK_MS = 25; //The match runs at 40 ticks a second whatever the frame rate
+const int MAX_CATCH_UP = 10; //Ticks run at most per frame; beyond that the match slows down
+
+Level level; //The stages played: the game's own, or those -level names
+GameParams params;
+GameState game;
+GameState previousTick; //game one tick ago, to draw in between
+MultiBall balls(0, 1); //Multi-ball mode's extra balls, if any
+double nextTick = 0; //When the next tick is due, on the timings clock
+Timings timings; //Toggled with 't'
+InputRecorder recorder; //Every input of the session, for dxball_sim replay
+StatsLog stats; //Every point of the session, in points.csv
+float _cameraAngle = 0.0;
+vector<double> unseenInputs[TIMING_KINDS]; //When inputs not on screen yet came in, by latency kind
+int latencyInputs = 0; //Synthetic inputs to play for -latency
+bool bots[2] = { false, false }; //Whether the computer plays each Side
+Netplay netplay; //-net: the other paddle is played on another machine
+bool netStarted = false; //Whether the session log has been started for it
+SpectatorServer spectators; //-spectate
+//Startup, on the timings clock: main() began, the window was up, init() was
+//done and the first frame was on screen (-1 until it is)
+double mainStarted = 0, windowShown = 0, initDone = 0, firstFrame = -1;
+bool texturesPending = true; //Whether uploadTextures() has more to do
+
+//Which latency an input counts towards
+TimingKind latencyKind(InputType input)
+{
+	switch (input) {
+	case INPUT_TOP_LEFT:
+	case INPUT_TOP_RIGHT:
+		return TIME_MOUSE_LATENCY;
+	case INPUT_TOP_TILT_LEFT:
+	case INPUT_TOP_TILT_RIGHT:
+		return TIME_BUTTON_LATENCY;
 	default:
-		assert(!"Unknown bitmap format");
-	}
-
-	//Read the data
-	int bytesPerRow = ((width * 3 + 3) / 4) * 4 - (width * 3 % 4);
-	int size = bytesPerRow * height;
-	auto_array<char> pixels(new char[size]);
-	input.seekg(dataOffset, ios_base::beg);
-	input.read(pixels.get(), size);
-
-	//Get the data into the right format
-	auto_array<char> pixels2(new char[width * height * 3]);
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			for (int c = 0; c < 3; c++) {
-				pixels2[3 * (width * y + x) + c] =
-					pixels[bytesPerRow * y + 3 * x + (2 - c)];
-			}
-		}
+		return TIME_KEY_LATENCY;
 	}
-
-	input.close();
-	return new Image(pixels2.release(), width, height);
 }
 
-GLuint loadTexture(Image* image) {
-
-	GLuint textureId;
-
-	glGenTextures(1, &textureId); //Make room for our texture
-
-	glBindTexture(GL_TEXTURE_2D, textureId); //Tell OpenGL which texture to edit
-
-											 //Map the image to the texture
-
-	glTexImage2D(GL_TEXTURE_2D,                //Always GL_TEXTURE_2D
-
-		0,                            //0 for now
-
-		GL_RGB,                       //Format OpenGL uses for image
-
-		image->width, image->height,  //Width and height
-
-		0,                            //The border of the image
-
-		GL_RGB, //GL_RGB, because pixels are stored in RGB format
-
-		GL_UNSIGNED_BYTE, //GL_UNSIGNED_BYTE, because pixels are stored
-
-						  //as unsigned numbers
-
-		image->pixels);               //The actual pixel data
-
-	return textureId; //Returns the id of the texture
-
+//Applies an input to the match and logs it
+void logInput(InputType input)
+{
+	//In netplay it is sent with the next tick and logged once the other
+	//side has confirmed that tick, but shown straight away all the same
+	if (netplay.active() && !netplay.addLocal(input))
+		return;
+	applyInput(game, input);
+	//Also to the tick before, so the frames drawn in between show it too
+	applyInput(previousTick, input);
+	if (!netplay.active())
+		recorder.record(game.tick, input);
 }
 
-int level = 0;
-int score1 = 0;
-int score2 = 0;
-float _angle = 0.0;
-float _cameraAngle = 0.0;
-float _ang_tri = 0.0;
-float xbot, xtop = 0;
-float ballx, bally = 0;
-float xspeed = 0;
-float yspeed = 0;
-int st = 0;
-float storex = 0;
-int pause = 0;
-int stage = 1;
-int kupdown = 0;
-int mupdown = 0;
-GLuint _stage1;
-GLuint _plank1;
-GLuint _ball;
-GLuint _barrier;
-
-GLuint _stage2;
-GLuint _plank2;
-GLuint _ball2;
-GLuint _barrier2;
-
-GLuint _plank3;
-GLuint _fan;
-
-void init(void)
+//Whether input moves a paddle the computer is playing
+bool botsPaddle(InputType input)
 {
-	glEnable(GL_COLOR_MATERIAL);
-	glEnable(GL_NORMALIZE);
-
-	Image* plank3 = loadBMP("plank3.bmp");
-	_plank3 = loadTexture(plank3);
-	delete plank3;
-	Image* fan = loadBMP("fan.bmp");
-	_fan = loadTexture(fan);
-	delete fan;
-
-	Image* stage1 = loadBMP("stage1.bmp");
-	Image* plank1 = loadBMP("plank1.bmp");
-	Image* ball = loadBMP("ball.bmp");
-	Image* barrier = loadBMP("barrier.bmp");
-	_stage1 = loadTexture(stage1);
-	_plank1 = loadTexture(plank1);
-	_ball = loadTexture(ball);
-	_barrier = loadTexture(barrier);
-	delete stage1;
-	delete plank1;
-	delete ball;
-	delete barrier;
-
-	Image* stage2 = loadBMP("stage2.bmp");
-	Image* plank2 = loadBMP("plank2.bmp");
-	Image* ball2 = loadBMP("ball2.bmp");
-	Image* barrier2 = loadBMP("barrier2.bmp");
-	_stage2 = loadTexture(stage2);
-	_plank2 = loadTexture(plank2);
-	_ball2 = loadTexture(ball2);
-	_barrier2 = loadTexture(barrier2);
-	delete stage2;
-	delete plank2;
-	delete ball2;
-	delete barrier2;
-
-	GLfloat light_position[] = { 0, 0, 3, .0 };
-	GLfloat red_light_position[] = { ballx, bally, 1, .0 };
-	GLfloat blue_light_position[] = { xtop, 5.3,0., 0.0 };
-	GLfloat white_light[] = { 1, 1, 1, .0 };
-	GLfloat red_light[] = { 1.0, 0.0,0.0, 1.0 };
-	GLfloat blue_light[] = { 0.0, 0.0,1.0, 1.0 };
-	GLfloat lmodel_ambient[] = { 0.2, 0.2, 0.2, 0.2 };
-	glClearColor(0, 0, 0, 0);
-	glShadeModel(GL_SMOOTH);
-
-	glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, white_light);
-	glLightfv(GL_LIGHT0, GL_SPECULAR, white_light);
-
-	glLightfv(GL_LIGHT1, GL_POSITION, red_light_position);
-	glLightfv(GL_LIGHT1, GL_DIFFUSE, red_light);
-	glLightfv(GL_LIGHT1, GL_SPECULAR, red_light);
-
-	glLightfv(GL_LIGHT2, GL_POSITION, blue_light_position);
-	glLightfv(GL_LIGHT2, GL_DIFFUSE, blue_light);
-	glLightfv(GL_LIGHT2, GL_SPECULAR, blue_light);
-
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient);
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-	//glEnable(GL_LIGHT1);
-	//glEnable(GL_LIGHT2);
-	glEnable(GL_DEPTH_TEST);
-
+	if (input <= INPUT_BOTTOM_DOWN)
+		return bots[SIDE_BOTTOM];
+	if (input <= INPUT_TOP_TILT_RIGHT)
+		return bots[SIDE_TOP];
+	return false;
 }
 
-void BatBall() {
-
-	GLfloat no_mat[] = { 0.0, 0.0, 0.0, 1.0 };
-	GLfloat mat_ambient[] = { 0.7, 0.7, 0.7, 1.0 };
-	GLfloat mat_ambient_color[] = { 0.8, 0.8, 0.2, 1.0 };
-	GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
-	GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
-	GLfloat no_shininess[] = { 0.0 };
-	GLfloat low_shininess[] = { 5.0 };
-	GLfloat high_shininess[] = { 100.0 };
-	GLfloat mat_emission[] = { 0.3, 0.2, 0.2, 0.0 };
-
-	glEnable(GL_TEXTURE_2D);
-	if (stage == 1)
-		glBindTexture(GL_TEXTURE_2D, _stage1);
-	else glBindTexture(GL_TEXTURE_2D, _stage2);
-
-	glPushMatrix();       /////////STAGE background
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-	glMaterialfv(GL_FRONT, GL_EMISSION, mat_ambient);
-	glColor3f(1, 1, 1);
-	glBegin(GL_QUADS);
-	glTexCoord2f(1, 1); glVertex3f(10, 10, -2);
-	glTexCoord2f(1, 0); glVertex3f(10, -10, -2);
-	glTexCoord2f(0, 0); glVertex3f(-10, -10, -2);
-	glTexCoord2f(0, 1); glVertex3f(-10, 10, -2);
-	glEnd();
-	glPopMatrix();
-
-	glPushMatrix(); // BOTTOM PLAYER
-	glEnable(GL_TEXTURE_GEN_S); //enable texture coordinate generation
-	glEnable(GL_TEXTURE_GEN_T);
-	if (stage == 1)
-		glBindTexture(GL_TEXTURE_2D, _plank1);
-	else glBindTexture(GL_TEXTURE_2D, _plank2);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTranslatef(0, -8.4, 0);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-	glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-	glTranslatef(xbot, 0, 0.0);
-	if (kupdown > 0)
-		glRotatef(20, 0, 0, 1);
-	else if (kupdown < 0)
-		glRotatef(-20, 0, 0, 1);
-	else glRotatef(0, 0, 0, 1);
-	glScalef(3, 1, 1);
-	glutSolidCube(1);
-	glPopMatrix();
-
-
-	glPushMatrix(); // TOP PLAYER
-	glTranslatef(0, 8.4, 0);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-	glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-	glTranslatef(xtop, 0, 0.0);
-	if (mupdown < 0)
-		glRotatef(20, 0, 0, 1);
-	else if (mupdown>0)
-		glRotatef(-20, 0, 0, 1);
-	else glRotatef(0, 0, 0, 1);
-	glScalef(3, 1, 1);
-	glutSolidCube(1);
-	glPopMatrix();
-
-	glColor3f(0.5, 0.5, 0.5);
-
-	if (stage == 1)
-	{
-		glPushMatrix();// middle berricade
-		glTranslatef(0, 0, -1);
-		glBindTexture(GL_TEXTURE_2D, _barrier);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(_ang_tri, 1, 0, 0);
-		glScalef(11, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix();
-		glTranslatef(-9, 0, -1);//LEFT BARRIER
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-_ang_tri, 1, .0, 0);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix();// RIGHT Barrier
-		glTranslatef(9, 0, -1);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-_ang_tri, 1, .0, 0);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glDisable(GL_TEXTURE_GEN_S); //enable texture coordinate generation
-		glDisable(GL_TEXTURE_GEN_T);
-		glDisable(GL_TEXTURE_2D);
-		glPopMatrix();
-		if (stage == 1)
-			glColor3f(1, 0, 0);
-		else glColor3f(0, 0, 1);
-
-		glPushMatrix();
-		glTranslatef(6.8, 0, 0);// RIGHT FAN
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(_angle, 0, .0, 1);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix();
-		glTranslatef(6.8, 0, 0);// RIGHT FAN2
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(90, 0, 0, 1);
-		glRotatef(_angle, 0, .0, 1);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // LEFT FAN
-		glTranslatef(-6.8, 0, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(-_angle, 0, .0, 1);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // LEFT FAN2
-		glTranslatef(-6.8, 0, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(90, 0, 0, 1);
-		glRotatef(-_angle, 0, .0, 1);
-		glScalef(2, .3, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // Left barricade
-		glEnable(GL_TEXTURE_2D);
-		glEnable(GL_TEXTURE_GEN_S); //enable texture coordinate generation
-		glEnable(GL_TEXTURE_GEN_T);
-		glBindTexture(GL_TEXTURE_2D, _plank3);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(-9.95, 0, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 20, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // RIGHT barricade
-		glBindTexture(GL_TEXTURE_2D, _plank3);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(9.95, 0, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 20, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-	}
-	if (stage == 2) {
-
-		glPushMatrix(); // MIDDLE FAN
-		glDisable(GL_TEXTURE_GEN_S); //disable texture coordinate generation
-		glDisable(GL_TEXTURE_GEN_T);
-		glDisable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, _fan);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glPushMatrix();////////////////////right fan
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(_angle, 0, .0, 1);
-		glScalef(4, .5, 1);
-		glColor3f(0, 0, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // MIDDLE FAN2
-		glDisable(GL_TEXTURE_GEN_S); //disable texture coordinate generation
-		glDisable(GL_TEXTURE_GEN_T);
-		glDisable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, _fan);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glPushMatrix();////////////////////right fan
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glRotatef(-10, 1, 0, 0);
-		glRotatef(90, 0, 0, 1);
-		glRotatef(_angle, 0, .0, 1);
-		glScalef(4, .5, 1);
-		glColor3f(0, 0, 1);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glEnable(GL_TEXTURE_2D);
-		glEnable(GL_TEXTURE_GEN_S); //enable texture coordinate generation
-		glEnable(GL_TEXTURE_GEN_T);
-		glPushMatrix(); // LEFT bottom barricade stage2
-		glBindTexture(GL_TEXTURE_2D, _barrier2);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(-9.95, -8, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 7, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // RIGHT bottom barricade stage 2
-		glBindTexture(GL_TEXTURE_2D, _barrier2);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(9.95, -8, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 7, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // LEFT TOP barricade stage2
-		glBindTexture(GL_TEXTURE_2D, _barrier2);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(-9.95, 8, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 7, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-
-		glPushMatrix(); // RIGHT TOP barricade stage 2
-		glBindTexture(GL_TEXTURE_2D, _barrier2);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTranslatef(9.95, 8, 0);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, no_mat);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-		glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-		glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-		glScalef(.2, 7, .2);
-		glutSolidCube(1);
-		glPopMatrix();
-
-	}
-	glPushMatrix();//////////////////////////sphereeeeeeeeeeeeeeee
-	if (stage == 1)
-		glBindTexture(GL_TEXTURE_2D, _ball);
-	else glBindTexture(GL_TEXTURE_2D, _ball2);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTranslatef(ballx, bally, 0);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
-	glMaterialfv(GL_FRONT, GL_EMISSION, no_mat);
-	glColor3f(1, 1, 1);
-	glutSolidSphere(.5, 30, 30);
-	glPopMatrix();
-
-	glDisable(GL_TEXTURE_GEN_S); //disable texture coordinate generation
-	glDisable(GL_TEXTURE_GEN_T);
-	glDisable(GL_TEXTURE_2D);
+//Applies an input from the keyboard or mouse
+void playerInput(InputType input)
+{
+	if (botsPaddle(input))
+		return;
+	if (timings.enabled)
+		unseenInputs[latencyKind(input)].push_back(timings.now());
+	logInput(input);
 }
 
 void handleKeypress(unsigned char key, //The key that was pressed                                                                                                           
@@ -666,28 +120,19 @@ void handleKeypress(unsigned char key, //The key that was pressed
 	case 27: //Escape key                                                                                                                                       
 		exit(0); //Exit the program                                                                                                                               
 	case 'p':
-		if (pause == 0)
-			pause = 1;
-		else pause = 0;
+		playerInput(INPUT_PAUSE);
+		break;
+	case 't':
+		timings.enabled = !timings.enabled;
 		break;
 	}
 }
 void myMouse(int button, int state, int x, int y) {      // mouse click callback
 	if (state == GLUT_DOWN) {
-
-
-		if (button == GLUT_LEFT_BUTTON) {
-			if (mupdown >= 0)
-				mupdown = mupdown - 1;
-
-		}
-
-		else if (button == GLUT_RIGHT_BUTTON) {
-
-			if (mupdown <= 0)
-				mupdown = mupdown + 1;
-
-		}
+		if (button == GLUT_LEFT_BUTTON)
+			playerInput(INPUT_TOP_TILT_LEFT);
+		else if (button == GLUT_RIGHT_BUTTON)
+			playerInput(INPUT_TOP_TILT_RIGHT);
 	}
 }
 
@@ -696,59 +141,41 @@ void keyboard(int key, int x, int y)
 	switch (key) {
 
 	case GLUT_KEY_PAGE_UP:
-		if (xspeed > 0) {
-			xspeed = xspeed + .01;
-		}
-		else if (xspeed <0) {
-			xspeed = xspeed - .01;
-		}
-		if (yspeed > 0)
-			yspeed = yspeed + .01;
-		else yspeed = yspeed - .01;
+		playerInput(INPUT_SPEED_UP);
 		break;
 
 	case GLUT_KEY_PAGE_DOWN:
-		if (xspeed > 0) {
-			xspeed = xspeed - .01;
-		}
-		else if (xspeed < 0) {
-			xspeed = xspeed + .01;
-		}
-		if (yspeed > 0)
-			yspeed = yspeed - .01;
-		else yspeed = yspeed + .01;
+		playerInput(INPUT_SPEED_DOWN);
 		break;
 
 	case GLUT_KEY_RIGHT:
-		xbot = xbot + .6;
-		if (xbot > 8.6)
-			xbot = 8.6;
+		playerInput(INPUT_BOTTOM_RIGHT);
 		glutPostRedisplay();
-
 		break;
 
 	case GLUT_KEY_LEFT:
-		xbot = xbot - .6;
-		if (xbot < -8.6)
-			xbot = -8.6;
+		playerInput(INPUT_BOTTOM_LEFT);
 		glutPostRedisplay();
-
 		break;
-	case GLUT_KEY_UP:
-		if (kupdown <= 0)
-			kupdown = kupdown + 1;
 
+	case GLUT_KEY_UP:
+		playerInput(INPUT_BOTTOM_UP);
 		break;
-	case GLUT_KEY_DOWN:
-		if (kupdown >= 0)
-			kupdown = kupdown - 1;
 
+	case GLUT_KEY_DOWN:
+		playerInput(INPUT_BOTTOM_DOWN);
 		break;
+
 	case GLUT_KEY_F1:
-		if (stage == 1)
-			stage = 2;
-		else stage = 1;
+		playerInput(INPUT_STAGE);
+		break;
+
+	case GLUT_KEY_F2:
+		bots[SIDE_BOTTOM] = !bots[SIDE_BOTTOM];
+		break;
 
+	case GLUT_KEY_F3:
+		bots[SIDE_TOP] = !bots[SIDE_TOP];
 		break;
 
 	default:
@@ -760,432 +187,341 @@ void keyboard(int key, int x, int y)
 }
 
 
-void display(void)
+//Draws p50/p99/max of the recent timings, and the GL state calls of the
+//last frame, over the game
+void drawTimings()
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glMatrixMode(GL_MODELVIEW);
+	static const char* names[TIMING_KINDS] = { "update  ", "BatBall ", "display ", "tick gap",
+		"key     ", "mouse   ", "button  " };
+	timings.drain();
+	glState.disable(GL_LIGHTING);
+	glState.disable(GL_TEXTURE_2D);
+	glState.disable(GL_DEPTH_TEST);
+	glState.matrixMode(GL_PROJECTION);
+	glPushMatrix();
 	glLoadIdentity();
-	BatBall();
-	glFlush();
-	glutSwapBuffers();
+	glState.matrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glState.color(1, 1, 0);
+	for (int k = 0; k < TIMING_KINDS; k++) {
+		TimingSummary s = timings.summary(k);
+		char line[80];
+		sprintf(line, "%s p50 %7.3f  p99 %7.3f  max %7.3f ms", names[k], s.p50, s.p99, s.max);
+		glRasterPos2f(-.97, .93 - .06 * k);
+		for (char* c = line; *c != 0; c++)
+			glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *c);
+	}
+	const GLStateCounts &state = glState.lastFrame;
+	char line[80];
+	sprintf(line, "GL state calls  issued %ld  elided %ld", state.totalIssued(), state.totalElided());
+	glRasterPos2f(-.97, .93 - .06 * TIMING_KINDS);
+	for (char* c = line; *c != 0; c++)
+		glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *c);
+	if (timings.dropped > 0) {
+		//The figures above are missing these
+		sprintf(line, "%ld samples dropped, queue full", timings.dropped);
+		glRasterPos2f(-.97, .93 - .06 * (TIMING_KINDS + 1));
+		for (char* c = line; *c != 0; c++)
+			glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *c);
+	}
+	glPopMatrix();
+	glState.matrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glState.matrixMode(GL_MODELVIEW);
+	glState.enable(GL_LIGHTING);
+	glState.enable(GL_DEPTH_TEST);
 }
 
+//Ends the latency of the inputs shown by the frame just swapped.  glFinish()
+//waits until the frame is drawn, as close to the screen as GL can tell.
+void presentInputs()
+{
+	bool waiting = false;
+	for (int k = 0; k < TIMING_KINDS; k++)
+		waiting = waiting || !unseenInputs[k].empty();
+	if (!waiting)
+		return;
+	glFinish();
+	double presented = timings.now();
+	for (int k = 0; k < TIMING_KINDS; k++) {
+		for (size_t i = 0; i < unseenInputs[k].size(); i++)
+			timings.record(k, unseenInputs[k][i], presented);
+		unseenInputs[k].clear();
+	}
+}
 
-void start() {
+void update();
 
-	if (st == 0) {
-		_ang_tri = 31;
-		xspeed = 0;
-		if (rand() % 2 == 0)
-			yspeed = .15;
-		else yspeed = -.15;
+//Runs the ticks that have come due since the last frame
+void advance()
+{
+	double now = timings.now();
+	int ticks = 0;
+	while (now >= nextTick && ticks < MAX_CATCH_UP) {
+		previousTick = game;
+		update();
+		nextTick += TICK_MS;
+		ticks++;
 	}
-	st = 1;
+	if (now >= nextTick)
+		nextTick = now + TICK_MS; //Too far behind (e.g. the window was dragged)
 }
 
-float mouseChange = .1;
-int  tempY = 0;
-void myMouseMove(int x, int y)
+void display(void)
 {
+	double start = timings.now();
+	advance();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glState.matrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	double batBall = timings.now();
+	//Drawn a tick behind, between the last two ticks
+	float t = (float)(1 - (nextTick - batBall) / TICK_MS);
+	t = t < 0 ? 0 : t > 1 ? 1 : t;
+	BatBall(interpolate(previousTick, game, t));
+	if (balls.size() > 0)
+		drawBalls(game, balls, t);
+	if (timings.enabled) {
+		timings.record(TIME_BATBALL, batBall, timings.now());
+		drawTimings();
+	}
+	glFlush();
+	glutSwapBuffers();
+	glState.endFrame();
+	if (timings.enabled)
+		timings.record(TIME_DISPLAY, start, timings.now());
+	presentInputs();
+	if (firstFrame < 0) {
+		glFinish();
+		firstFrame = timings.now();
+		cout << "Startup: window " << windowShown - mainStarted << " ms, init() " << initDone - windowShown
+			<< " ms, first frame " << firstFrame - mainStarted << " ms after main()\n";
+	}
+}
 
 
+int  tempY = 0;
+void myMouseMove(int x, int y)
+{
 	if (tempY > x && tempY >= 0 && tempY <= 899)
-	{
-		if (xtop < -8.6)
-			xtop = -8.6;
-		else
-			xtop = xtop - mouseChange;
-
-	}
-
+		playerInput(INPUT_TOP_LEFT);
 	else if (tempY < x && tempY >= 0 && tempY <= 899)
-	{
-
-		if (xtop >8.6)
-			xtop = 8.6;
-		else
-			xtop = xtop + mouseChange;
-	}
+		playerInput(INPUT_TOP_RIGHT);
 	tempY = x;
 	glutPostRedisplay();
 }
 
-void update(int value) {
-	if (pause == 0) {
-		_angle += 20.0f;
-		if (_angle > 360) {
-			_angle -= 360;
-		}
-		_ang_tri += 5.0f;
-		if (_ang_tri > 360) {
-			_ang_tri -= 360;
-		}
-	}
-	start();
-
-	if (stage == 1 && ballx <= 6.8 + 1.4 && ballx >= 6.8 - 1.4 && bally < .1 && bally > -.1) {// Right FAN EFFECT
-		int x = 0;
-		if (xspeed == 0) {
-			if (rand() % 2 == 0)
-				xspeed = storex;
-			else xspeed = -storex;
-
-		}
-		else if (rand() % 2 == 0) {
-			xspeed = -xspeed;
-			x = 1;
-		}
-		else if (yspeed < 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed > 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed<< "\n";
-		}
-		else if (yspeed > 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed < 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		if (x == 0 && (ballx <= 6.8 + .5 && ballx >= 6.8 - .5))
-			xspeed = -xspeed;
+//One tick of a netplay match.  The session log and points.csv only get
+//ticks both sides have confirmed, so a rolled back point is never counted.
+void netTick()
+{
+	if (netplay.tick())
+		game = netplay.state();
+	if (!netStarted && netplay.started()) {
+		recorder.open("session.dxin", netplay.seed(), &params); //The top side has only now got the seed
+		netStarted = true;
 	}
-
-	if (stage == 1 && ballx <= -6.8 + 1.4 && ballx >= -6.8 - 1.4 && bally < .1 && bally > -.1) {// LEFT FAN EFFECT
-		int x = 0;
-		if (xspeed == 0) {
-			if (rand() % 2 == 0)
-				xspeed = storex;
-			else xspeed = -storex;
-		}
-		else if (rand() % 2 == 0) {
-			xspeed = -xspeed;
-			x = 1;
-		}
-		else if (yspeed < 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed > 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed > 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed < 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		if (x == 0 && (ballx <= -6.8 + .5 && ballx >= -6.8 - .5))
-			xspeed = -xspeed;
+	for (size_t i = 0; i < netplay.confirmedTicks.size(); i++) {
+		const NetTick &t = netplay.confirmedTicks[i];
+		for (int k = 0; k < t.inputs.count; k++)
+			recorder.record(t.tick, (InputType)t.inputs.types[k]);
+		if (t.scored)
+			stats.record(t.tick + 1, t.point);
 	}
-
-	if (stage == 2 && ballx <= 2.5 && ballx >= -2.5 && bally < .1 && bally > -.1) {// MIDDLE FAN EFFECT
-		int x = 0;
-		if (xspeed == 0) {
-			if (storex == 0) {
-				if (rand() % 2 == 0)
-					xspeed = -.12;
-				else xspeed = .12;
-			}
-			else if (rand() % 2 == 0)
-				xspeed = storex;
-			else xspeed = -storex;
-
-		}
-		else if (rand() % 2 == 0) {
-			xspeed = -xspeed;
-			x = 1;
-		}
-		else if (yspeed < 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		else if (yspeed > 0 && xspeed < 0) {
-			xspeed = xspeed - .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-
-		}
-		else if (yspeed > 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed + .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-
-		}
-		else if (yspeed < 0 && xspeed > 0) {
-			xspeed = xspeed + .01;
-			yspeed = yspeed - .01;
-			level = level + 1;
-			//cout << xspeed << "  " << yspeed << "\n";
-		}
-		if (x == 0 && (ballx <= 1 && ballx >= -1))
-			xspeed = -xspeed;
+	netplay.confirmedTicks.clear();
+	if (netplay.error != NULL) {
+		cerr << "Netplay stopped: " << netplay.error << "\n";
+		exit(1);
 	}
+}
 
-	// BARRIER EFFECT
-	if (stage == 1 && ballx <= 14 && ballx >= -14 && bally < .1 && bally > -.1 && ((_ang_tri >= 335 && _ang_tri <= 360) || (_ang_tri <= 25 && _ang_tri >= 0) || (_ang_tri <= -335 && _ang_tri >= -360) || (_ang_tri >= -25 && _ang_tri <= 0) || (_ang_tri >= 155 && _ang_tri <= 205) || (_ang_tri <= -155 && _ang_tri >= -205)))
-	{
-		yspeed = -yspeed;
-		if (xspeed == 0) {
-			if (storex == 0) {
-				if (rand() % 2 == 0)
-					xspeed = .12;
-				else xspeed = -.12;
-			}
-			else if (rand() % 2 == 0)
-				xspeed = storex;
-			else xspeed = -storex;
-		}
-		else if (rand() % 2 == 0)
-			xspeed = -xspeed;
+//One tick of the match
+void update() {
+	static double lastUpdate = -1;
+	double start = timings.now();
+	if (timings.enabled && lastUpdate >= 0)
+		timings.record(TIME_TICK_GAP, lastUpdate, start);
+	lastUpdate = start;
+
+	Inputs moves;
+	if (bots[SIDE_BOTTOM] && bots[SIDE_TOP] && game.pause != 0 && !netplay.active())
+		moves.push(INPUT_PAUSE); //Nobody to serve
+	for (int side = SIDE_BOTTOM; side <= SIDE_TOP; side++) {
+		if (bots[side] && (!netplay.active() || side == netplay.side))
+			botInputs(game, (Side)side, moves);
 	}
-
-	if (ballx <= xbot + 2 && ballx >= xbot - 2 && bally < -7.6 && bally > -7.8) {//Bottom player effect
-		int x = rand() % 3 + 1;
-		if (kupdown < 0) {
-			if (xspeed > 0) {
-			}
-			else if (xspeed < 0) {
-				xspeed = -xspeed;
-			}
-			else if (xspeed == 0 && storex == 0) {
-				xspeed = .12;
-			}
-			else if (xspeed == 0 && storex>0) {
-				xspeed = storex;
-			}
-			else if (xspeed == 0 && storex < 0) {
-				xspeed = -storex;
-			}
-		}
-		else if (kupdown == 0) {
-			if (xspeed == 0) {
-
-				if (x == 1) {
-					if (storex == 0)
-						xspeed = -.12;
-					else if (storex > 0)
-						xspeed = -storex;
-					else xspeed = storex;
-				}
-				else if (x == 2) {
-					if (storex == 0)
-						xspeed = .12;
-					else if (storex > 0)
-						xspeed = storex;
-					else xspeed = -storex;
-				}
-			}
-			else if (x == 1)
-				xspeed = -xspeed;
-			else if (x == 2) {
-				storex = xspeed;
-				xspeed = 0;
-			}
-		}
-		else if (kupdown > 0) {
-			if (xspeed < 0) {
-			}
-			else if (xspeed > 0) {
-				xspeed = -xspeed;
-			}
-			else if (xspeed == 0 && storex == 0) {
-				xspeed = -.12;
-			}
-			else if (xspeed == 0 && storex>0) {
-				xspeed = -storex;
-			}
-			else if (xspeed == 0 && storex < 0) {
-				xspeed = storex;
-			}
-		}
-		yspeed = -yspeed;
-		// cout << xspeed << "  " << yspeed << "\n";
+	for (int i = 0; i < moves.count; i++)
+		logInput((InputType)moves.types[i]);
+
+	if (netplay.active())
+		netTick();
+	else {
+		PointRecord point;
+		if (step(game, Inputs(), &point))
+			stats.record(game.tick, point);
+		balls.step(game);
 	}
-	if (ballx <= xtop + 2 && ballx >= xtop - 2 && bally > 7.6 && bally < 7.8) {//top player effect
-
-		int x = rand() % 3 + 1;
-		if (mupdown < 0) {
-			if (xspeed > 0) {
-			}
-			else if (xspeed < 0) {
-				xspeed = -xspeed;
-			}
-			else if (xspeed == 0 && storex == 0) {
-				xspeed = .12;
-			}
-			else if (xspeed == 0 && storex>0) {
-				xspeed = storex;
-			}
-			else if (xspeed == 0 && storex < 0) {
-				xspeed = -storex;
-			}
-		}
-		else if (mupdown == 0) {
-			if (xspeed == 0) {
+	if (spectators.active())
+		spectators.publish(game);
+	if (timings.enabled)
+		timings.record(TIME_UPDATE, start, timings.now());
+}
 
-				if (x == 1) {
-					if (storex == 0)
-						xspeed = -.12;
-					else if (storex > 0)
-						xspeed = -storex;
-					else xspeed = storex;
-				}
-				else if (x == 2) {
-					if (storex == 0)
-						xspeed = .12;
-					else if (storex > 0)
-						xspeed = storex;
-					else xspeed = -storex;
-				}
-			}
-			else if (x == 1)
-				xspeed = -xspeed;
-			else if (x == 2) {
-				storex = xspeed;
-				xspeed = 0;
-			}
-		}
-		else if (mupdown > 0) {
-			if (xspeed < 0) {
-			}
-			else if (xspeed > 0) {
-				xspeed = -xspeed;
-			}
-			else if (xspeed == 0 && storex == 0) {
-				xspeed = -.12;
-			}
-			else if (xspeed == 0 && storex>0) {
-				xspeed = -storex;
-			}
-			else if (xspeed == 0 && storex < 0) {
-				xspeed = storex;
-			}
-		}
-		yspeed = -yspeed;
-		//cout << xspeed << "  " << yspeed << "\n";
-	}
-	if (bally > 8.3 || bally < -8.3)////////////reset
-	{
-		if (bally > 8.3)
-			score1 = score1 + 1;
-		else score2 = score2 + 1;
-		ballx = 0;
-		if (stage == 2)
-			bally = 0;
-		else bally = .1;
-		st = 0;
-		xtop = 0;
-		xbot = 0;
-		cout << "Player ONE :" << score1 << " -- Player TWO : " << score2 << "\n";
-		cout << "At speed" << xspeed << "  " << yspeed << "\n";
-		cout << "At Level " << level << "\n";
-		cout << "In Stage " << stage << "\n" << "\n";
-		level = 0;
-		storex = 0;
-		pause = 1;
-		if (stage == 1)
-			stage = 2;
-		else stage = 1;
-	}
-	if (pause == 0) {
-		bally = bally + yspeed;
-		ballx = ballx + xspeed;
+//Draws frames back to back; with vsync on, the swap holds each one to the
+//display's refresh rate
+void idle()
+{
+	netplay.poll();
+	spectators.poll();
+	if (texturesPending && firstFrame >= 0 && !uploadTextures()) {
+		texturesPending = false;
+		cout << "Other stage textures uploaded " << timings.now() - mainStarted << " ms after main()\n";
 	}
-	if (stage == 2) {
-		if (ballx < -9.8 && bally >-4.5 && bally < 4.5) ///////////////LEFT Wall effect
-		{
-			ballx = -ballx;
-			ballx = ballx - .1;
+	glutPostRedisplay();
+}
 
-		}
-		else if (ballx > 9.8 && bally > -4.5 && bally < 4.5) ///////////////RIGHT Wall effect
-		{
-			ballx = -ballx;
-			ballx = ballx + .1;
+//Asks the driver to sync swaps to the display, if it knows how
+void enableVsync()
+{
+	typedef int (APIENTRY* SwapInterval)(int);
+#ifdef _WIN32
+	SwapInterval swapInterval = (SwapInterval)wglGetProcAddress("wglSwapIntervalEXT");
+#else
+	SwapInterval swapInterval = (SwapInterval)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+	if (swapInterval == NULL)
+		swapInterval = (SwapInterval)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
+#endif
+	if (swapInterval != NULL)
+		swapInterval(1);
+}
 
-		}
 
-		else if (bally <= -4.5 || bally >= 4.5) {
-			if (ballx > 9.8)
-				xspeed = -xspeed;
-			if (ballx < -9.8)
-				xspeed = -xspeed;
 
-		}
 
+//Prints the latencies measured by -latency and ends the program
+void latencyReport(int value)
+{
+	static const char* names[] = { "Keyboard     ", "Mouse motion ", "Mouse button " };
+	timings.drain();
+	cout << "Input to present, ms:\n";
+	for (int k = TIME_KEY_LATENCY; k <= TIME_BUTTON_LATENCY; k++) {
+		TimingSummary s = timings.overall(k);
+		cout << names[k - TIME_KEY_LATENCY] << "p50 " << s.p50 << "  p99 " << s.p99
+			<< "  max " << s.max << "  (" << s.count << " inputs)\n";
 	}
-	if (stage == 1) {
-		if (ballx > 9.4)
-			xspeed = -xspeed;
-		if (ballx < -9.4)
-			xspeed = -xspeed;
-	}
-	glutPostRedisplay(); //Tell GLUT that the display has changed
-
-						 //Tell GLUT to call update again in 25 milliseconds
-	glutTimerFunc(25, update, 0);
+	if (timings.dropped > 0)
+		cout << timings.dropped << " samples dropped with the queue full\n";
+	exit(0);
 }
 
-
-
-void reshape(int w, int h)
+//Plays synthetic input n through the real callbacks, taking turns between
+//the arrow keys, mouse motion and the mouse buttons.  The uneven gaps land
+//the inputs all over the 25 ms between ticks.
+void injectInput(int n)
 {
-	glViewport(0, 0, w, h);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	if (w <= (h * 2))
-		glOrtho(-10.0, 10.0, -4.0*((GLfloat)h * 3) / (GLfloat)w,
-			4.0*((GLfloat)h * 3) / (GLfloat)w, -10.0, 10.0);
-	else
-		glOrtho(-7.0*(GLfloat)w / ((GLfloat)h * 2),
-			7.0*(GLfloat)w / ((GLfloat)h * 2), -3.0, 3.0, -10.0, 10.0);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	bool left = (n / 3) % 2 == 0;
+	if (n % 3 == 0)
+		keyboard(left ? GLUT_KEY_LEFT : GLUT_KEY_RIGHT, 0, 0);
+	else if (n % 3 == 1)
+		myMouseMove(left ? 445 : 455, 0);
+	else myMouse(left ? GLUT_LEFT_BUTTON : GLUT_RIGHT_BUTTON, GLUT_DOWN, 0, 0);
+	if (n + 1 < latencyInputs)
+		glutTimerFunc(20 + rand() % 60, injectInput, n + 1);
+	else glutTimerFunc(250, latencyReport, 0);
 }
 
+//Keeps the timings of the session, if any were taken, and ends the input log
+void endSession()
+{
+	timings.drain();
+	timings.writeCSV("timings.csv");
+	if (timings.dropped > 0 || timings.overwritten > 0)
+		cout << "Timings: " << timings.dropped << " samples dropped with the queue full, "
+			<< timings.overwritten << " oldest not kept in timings.csv\n";
+	recorder.close(netplay.active() ? netplay.confirmedState() : game);
+	stats.close();
+	if (netplay.active()) {
+		const NetStats &s = netplay.stats;
+		cout << "Netplay: " << s.ticks << " ticks, " << s.predicted << " predicted, " << s.rollbacks
+			<< " rollbacks (" << s.resimulated << " ticks replayed, at most " << s.deepest << "), "
+			<< s.stalls + s.syncWaits << " ticks waited, " << s.desyncs << " desyncs\n";
+		netplay.close();
+	}
+	if (spectators.active()) {
+		const SpectateStats &s = spectators.stats;
+		cout << "Spectators: " << s.accepted << " in all, " << s.sent << " snapshots (" << s.keyframes << " whole), "
+			<< s.bytes << " bytes, " << s.publishMs + s.pollMs << " ms CPU\n";
+		spectators.close();
+	}
+	if (balls.size() > 0)
+		cout << "Multi-ball: Player ONE :" << balls.score1 << " -- Player TWO : " << balls.score2
+			<< " (" << balls.contacts << " ball to ball contacts)\n";
+}
 
 int main(int argc, char** argv)
 {
+	mainStarted = timings.now();
 	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+	unsigned int seed = (unsigned int)time(NULL);
+	if (argc > 2 && strcmp(argv[1], "-level") == 0) {
+		if (!level.load(argv[2])) {
+			cerr << "Could not read level " << argv[2] << "\n";
+			return 1;
+		}
+		params.level = &level;
+	}
+	if (argc > 4 && strcmp(argv[1], "-net") == 0) {
+		netplay.conditions.delayMs = argc > 5 ? atof(argv[5]) : 0;
+		netplay.conditions.lossPercent = argc > 6 ? atof(argv[6]) : 0;
+		if (!netplay.open(strcmp(argv[2], "top") == 0 ? SIDE_TOP : SIDE_BOTTOM, atoi(argv[3]), argv[4], seed, &params)) {
+			cerr << "Could not open port " << argv[3] << " for " << argv[4] << "\n";
+			return 1;
+		}
+	}
+	if (argc > 2 && strcmp(argv[1], "-balls") == 0 && atoi(argv[2]) < 0) {
+		cerr << "Need 0 or more balls, not " << argv[2] << "\n";
+		return 1;
+	}
+	if (argc > 2 && strcmp(argv[1], "-spectate") == 0 && !spectators.listen(atoi(argv[2]))) {
+		cerr << "Could not listen on port " << argv[2] << "\n";
+		return 1;
+	}
+	game = GameState(seed, &params);
+	previousTick = game;
+	if (!netplay.active())
+		recorder.open("session.dxin", seed, &params);
+	stats.echo = true;
+	stats.open("points.csv");
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutInitWindowSize(900, 700);
 	glutCreateWindow(argv[0]);
-	init();
+	enableVsync();
+	windowShown = timings.now();
+	init(game);
+	initDone = timings.now();
 	glutReshapeFunc(reshape);
 	glutDisplayFunc(display);
-	glutTimerFunc(1, update, 1); //Add a timer
+	glutIdleFunc(idle);
 	glutKeyboardFunc(handleKeypress);
 	glutSpecialFunc(keyboard);
 	glutPassiveMotionFunc(myMouseMove);
 	glutMouseFunc(myMouse);
+	if (argc > 2 && strcmp(argv[1], "-bots") == 0) {
+		bots[SIDE_BOTTOM] = strcmp(argv[2], "top") != 0;
+		bots[SIDE_TOP] = strcmp(argv[2], "bottom") != 0;
+	}
+	if (argc > 2 && strcmp(argv[1], "-balls") == 0)
+		balls = MultiBall(atoi(argv[2]), seed);
+	if (argc > 1 && strcmp(argv[1], "-latency") == 0) {
+		latencyInputs = argc > 2 ? atoi(argv[2]) : 300;
+		if (latencyInputs > 0) {
+			timings.enabled = true;
+			glutTimerFunc(500, injectInput, 0);
+		}
+	}
+	atexit(endSession);
+	nextTick = timings.now();
 	glutMainLoop();
 	return 0;
 }
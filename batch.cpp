@@ -0,0 +1,427 @@
+#include "batch.h"
+#include "game.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#else
+#error "MatchBatch needs SSE2"
+#endif
+
+namespace {
+	//Thin layer over the intrinsics, so the kernel is written once for both
+	//register widths.  Masks are float vectors with all bits of a lane set.
+#if defined(__AVX2__)
+	typedef __m256 vf;
+	typedef __m256i vi;
+	const int WIDTH = 8;
+
+	inline vf loadf(const float* p) { return _mm256_load_ps(p); }
+	inline void storef(float* p, vf a) { _mm256_store_ps(p, a); }
+	inline vi loadi(const int* p) { return _mm256_load_si256((const __m256i*)p); }
+	inline void storei(int* p, vi a) { _mm256_store_si256((__m256i*)p, a); }
+	inline vf set(float a) { return _mm256_set1_ps(a); }
+	inline vi seti(int a) { return _mm256_set1_epi32(a); }
+	inline vf add(vf a, vf b) { return _mm256_add_ps(a, b); }
+	inline vf sub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+	inline vf mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+	inline vf div(vf a, vf b) { return _mm256_div_ps(a, b); }
+	inline vf band(vf a, vf b) { return _mm256_and_ps(a, b); }
+	inline vf bor(vf a, vf b) { return _mm256_or_ps(a, b); }
+	inline vf bxor(vf a, vf b) { return _mm256_xor_ps(a, b); }
+	inline vf andnot(vf a, vf b) { return _mm256_andnot_ps(a, b); } //~a & b
+	inline vf lt(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline vf le(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline vf eq(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	inline vf sel(vf m, vf a, vf b) { return _mm256_blendv_ps(b, a, m); }
+	inline vi addi(vi a, vi b) { return _mm256_add_epi32(a, b); }
+	inline vi subi(vi a, vi b) { return _mm256_sub_epi32(a, b); }
+	inline vi andi(vi a, vi b) { return _mm256_and_si256(a, b); }
+	inline vi xori(vi a, vi b) { return _mm256_xor_si256(a, b); }
+	inline vi shl(vi a, int n) { return _mm256_slli_epi32(a, n); }
+	inline vi shr(vi a, int n) { return _mm256_srli_epi32(a, n); }
+	inline vf eqi(vi a, vi b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+	inline vf gti(vi a, vi b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)); }
+	inline vi seli(vf m, vi a, vi b) {
+		return _mm256_castps_si256(sel(m, _mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+	}
+	inline vi maski(vf m) { return _mm256_castps_si256(m); }
+	inline bool any(vf m) { return _mm256_movemask_ps(m) != 0; }
+	inline vf tofloat(vi a) { return _mm256_cvtepi32_ps(a); }
+	inline vi toint(vf a) { return _mm256_cvttps_epi32(a); }
+#else
+	typedef __m128 vf;
+	typedef __m128i vi;
+	const int WIDTH = 4;
+
+	inline vf loadf(const float* p) { return _mm_load_ps(p); }
+	inline void storef(float* p, vf a) { _mm_store_ps(p, a); }
+	inline vi loadi(const int* p) { return _mm_load_si128((const __m128i*)p); }
+	inline void storei(int* p, vi a) { _mm_store_si128((__m128i*)p, a); }
+	inline vf set(float a) { return _mm_set1_ps(a); }
+	inline vi seti(int a) { return _mm_set1_epi32(a); }
+	inline vf add(vf a, vf b) { return _mm_add_ps(a, b); }
+	inline vf sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+	inline vf mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+	inline vf div(vf a, vf b) { return _mm_div_ps(a, b); }
+	inline vf band(vf a, vf b) { return _mm_and_ps(a, b); }
+	inline vf bor(vf a, vf b) { return _mm_or_ps(a, b); }
+	inline vf bxor(vf a, vf b) { return _mm_xor_ps(a, b); }
+	inline vf andnot(vf a, vf b) { return _mm_andnot_ps(a, b); } //~a & b
+	inline vf lt(vf a, vf b) { return _mm_cmplt_ps(a, b); }
+	inline vf le(vf a, vf b) { return _mm_cmple_ps(a, b); }
+	inline vf eq(vf a, vf b) { return _mm_cmpeq_ps(a, b); }
+	inline vf sel(vf m, vf a, vf b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	inline vi addi(vi a, vi b) { return _mm_add_epi32(a, b); }
+	inline vi subi(vi a, vi b) { return _mm_sub_epi32(a, b); }
+	inline vi andi(vi a, vi b) { return _mm_and_si128(a, b); }
+	inline vi xori(vi a, vi b) { return _mm_xor_si128(a, b); }
+	inline vi shl(vi a, int n) { return _mm_slli_epi32(a, n); }
+	inline vi shr(vi a, int n) { return _mm_srli_epi32(a, n); }
+	inline vf eqi(vi a, vi b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+	inline vf gti(vi a, vi b) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a, b)); }
+	inline vi seli(vf m, vi a, vi b) {
+		return _mm_castps_si128(sel(m, _mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+	}
+	inline vi maski(vf m) { return _mm_castps_si128(m); }
+	inline bool any(vf m) { return _mm_movemask_ps(m) != 0; }
+	inline vf tofloat(vi a) { return _mm_cvtepi32_ps(a); }
+	inline vi toint(vf a) { return _mm_cvttps_epi32(a); }
+#endif
+
+	inline vf band(vf a, vf b, vf c) { return band(band(a, b), c); }
+	inline vf band(vf a, vf b, vf c, vf d) { return band(band(a, b), band(c, d)); }
+	inline vf bor(vf a, vf b, vf c) { return bor(bor(a, b), c); }
+	inline vf gt(vf a, vf b) { return lt(b, a); }
+	inline vf ge(vf a, vf b) { return le(b, a); }
+	inline vf neg(vf a) { return bxor(a, set(-0.0f)); }
+	inline vf absf(vf a) { return andnot(set(-0.0f), a); }
+	//a + sign(a) * d, with zero left alone
+	inline vf away(vf a, float d) {
+		vf signd = bor(band(a, set(-0.0f)), set(d));
+		return sel(eq(a, set(0)), a, add(a, signd));
+	}
+	//Lanes where bit n of r is clear, i.e. where rand() % 2 == 0
+	inline vf even(vi r, int n) { return eqi(andi(r, seti(1 << n)), seti(0)); }
+
+	//Ball and paddle lanes (vr): floats, or with FIXED_POINT the raw 16.16
+	//values as ints, with the same operations as floats so the kernel below
+	//reads the same either way
+#ifdef FIXED_POINT
+	typedef vi vr;
+
+	inline vr loadr(const Fixed* p) { return loadi((const int*)p); }
+	inline void storer(Fixed* p, vr a) { storei((int*)p, a); }
+	inline vr real(double a) { return seti(Fixed(a).raw); }
+	inline vi add(vi a, vi b) { return addi(a, b); }
+	inline vi sub(vi a, vi b) { return subi(a, b); }
+	inline vi neg(vi a) { return subi(seti(0), a); }
+	inline vf lt(vi a, vi b) { return gti(b, a); }
+	inline vf gt(vi a, vi b) { return gti(a, b); }
+	inline vf le(vi a, vi b) { return andnot(gti(a, b), eqi(a, a)); }
+	inline vf ge(vi a, vi b) { return le(b, a); }
+	inline vf eq(vi a, vi b) { return eqi(a, b); }
+	inline vi sel(vf m, vi a, vi b) { return seli(m, a, b); }
+	inline vi absf(vi a) { return sel(lt(a, seti(0)), neg(a), a); }
+	inline vi away(vi a, float d) {
+		vi step = sel(lt(a, seti(0)), real(-d), real(d));
+		return sel(eq(a, seti(0)), a, add(a, step));
+	}
+#else
+	typedef vf vr;
+
+	inline vr loadr(const float* p) { return loadf(p); }
+	inline void storer(float* p, vr a) { storef(p, a); }
+	inline vr real(float a) { return set(a); }
+#endif
+
+	//x where the move from (px, py) to (bx, by) crosses y = mid, in the lanes
+	//of over; see crossingX() in game.cpp
+	inline vr crossingX(vr px, vr py, vr bx, vr by, float mid, vf over) {
+#ifdef FIXED_POINT
+		//No 64-bit multiply and divide across lanes, so lane by lane
+		alignas(32) int p[2][WIDTH], b[2][WIDTH], x[WIDTH], m[WIDTH];
+		storei(p[0], px);
+		storei(p[1], py);
+		storei(b[0], bx);
+		storei(b[1], by);
+		storei(m, maski(over));
+		int y = Fixed(mid).raw;
+		for (int i = 0; i < WIDTH; i++) {
+			x[i] = b[0][i];
+			if (m[i] != 0) {
+				long long moved = ((long long)y - p[1][i]) * ((long long)b[0][i] - p[0][i]);
+				x[i] = p[0][i] + (int)(moved / ((long long)b[1][i] - p[1][i]));
+			}
+		}
+		return loadi(x);
+#else
+		vf t = div(sub(set(mid), py), sub(by, py));
+		return sel(over, add(px, mul(t, sub(bx, px))), bx);
+#endif
+	}
+
+	//Swept band test, see crossesBand() in game.cpp
+	vf crossesBand(vr px, vr py, vr bx, vr by, float lo, float hi, vr &x, vf &over) {
+		vf inside = band(lt(by, real(hi)), gt(by, real(lo)));
+		over = andnot(inside, bor(band(ge(py, real(hi)), le(by, real(lo))), band(le(py, real(lo)), ge(by, real(hi)))));
+		x = bx;
+		if (any(over))
+			x = crossingX(px, py, bx, by, (lo + hi) / 2, over);
+		return bor(inside, over);
+	}
+
+	//Fan deflection, see fanEffect() in game.cpp
+	void fanEffect(vf m, vi r, vr ballx, vr &xspeed, vr &yspeed, vr storex,
+		vi &level, float center, float inner, bool middle) {
+		vf xzero = eq(xspeed, real(0));
+		vr stored = sel(even(r, 1), storex, neg(storex));
+		if (middle)
+			stored = sel(eq(storex, real(0)), sel(even(r, 1), real(-.12f), real(.12f)), stored);
+		vf flip = andnot(xzero, even(r, 2));
+		vf speedup = andnot(bor(xzero, flip, eq(yspeed, real(0))), m);
+		vr x = sel(xzero, stored, sel(flip, neg(xspeed), sel(speedup, away(xspeed, .01f), xspeed)));
+		vr y = sel(speedup, away(yspeed, .01f), yspeed);
+		vf hub = andnot(flip, band(le(ballx, real(center + inner)), ge(ballx, real(center - inner))));
+		x = sel(hub, neg(x), x);
+		xspeed = sel(m, x, xspeed);
+		yspeed = sel(m, y, yspeed);
+		level = subi(level, maski(band(m, speedup)));
+	}
+
+	//Barrier, see barrierClosed() in game.cpp
+	vf barrierClosed(vf a) {
+		vf closed = bor(band(ge(a, set(335)), le(a, set(360))), band(le(a, set(25)), ge(a, set(0))));
+		closed = bor(closed, band(le(a, set(-335)), ge(a, set(-360))), band(ge(a, set(-25)), le(a, set(0))));
+		return bor(closed, band(ge(a, set(155)), le(a, set(205))), band(le(a, set(-155)), ge(a, set(-205))));
+	}
+
+	//Paddle bounce, see paddleEffect() in game.cpp.  choice is rand() % 3 + 1.
+	void paddleEffect(vf m, vi tilt, vi choice, vr &xspeed, vr &yspeed, vr &storex) {
+		vf xzero = eq(xspeed, real(0));
+		vr side = sel(eq(storex, real(0)), real(.12f), absf(storex));
+		vf left = gti(seti(0), tilt);
+		vf right = gti(tilt, seti(0));
+		vf one = eqi(choice, seti(1));
+		vf two = eqi(choice, seti(2));
+
+		vr x = xspeed;
+		//Tilted: always send the ball to that side
+		x = sel(left, sel(xzero, side, absf(xspeed)), x);
+		x = sel(right, sel(xzero, neg(side), neg(absf(xspeed))), x);
+		//Flat, not moving sideways: pick a side or keep going straight
+		vf flat = andnot(bor(left, right), m);
+		vf flatZero = band(flat, xzero);
+		x = sel(band(flatZero, one), neg(side), sel(band(flatZero, two), side, x));
+		//Flat, moving sideways: reverse or go straight
+		vf flatMoving = andnot(xzero, flat);
+		x = sel(band(flatMoving, one), neg(xspeed), x);
+		vf stop = band(flatMoving, two);
+		storex = sel(stop, xspeed, storex);
+		x = sel(stop, real(0), x);
+
+		xspeed = sel(m, x, xspeed);
+		yspeed = sel(m, neg(yspeed), yspeed);
+	}
+
+	template<class T>
+	T* allocate(int n) {
+		T* p = (T*)_mm_malloc(n * sizeof(T), 32);
+		for (int i = 0; i < n; i++)
+			p[i] = T();
+		return p;
+	}
+}
+
+const int MatchBatch::LANES = WIDTH;
+
+MatchBatch::MatchBatch(int count_, unsigned int seed) : count(count_) {
+	padded = (count + WIDTH - 1) / WIDTH * WIDTH;
+	ballx = allocate<Real>(padded);
+	bally = allocate<Real>(padded);
+	prevx = allocate<Real>(padded);
+	prevy = allocate<Real>(padded);
+	xspeed = allocate<Real>(padded);
+	yspeed = allocate<Real>(padded);
+	storex = allocate<Real>(padded);
+	xbot = allocate<Real>(padded);
+	xtop = allocate<Real>(padded);
+	_angle = allocate<float>(padded);
+	_ang_tri = allocate<float>(padded);
+	kupdown = allocate<int>(padded);
+	mupdown = allocate<int>(padded);
+	stage = allocate<int>(padded);
+	st = allocate<int>(padded);
+	level = allocate<int>(padded);
+	rng = allocate<unsigned int>(padded);
+	score1 = allocate<int>(padded);
+	score2 = allocate<int>(padded);
+	rally = allocate<int>(padded);
+	rallyTotal = allocate<int>(padded);
+	levelTotal = allocate<int>(padded);
+
+	for (int i = 0; i < padded; i++) {
+		stage[i] = 1;
+		rng[i] = matchSeed(seed, i);
+	}
+}
+
+MatchBatch::~MatchBatch() {
+	_mm_free(ballx);
+	_mm_free(bally);
+	_mm_free(prevx);
+	_mm_free(prevy);
+	_mm_free(xspeed);
+	_mm_free(yspeed);
+	_mm_free(storex);
+	_mm_free(xbot);
+	_mm_free(xtop);
+	_mm_free(_angle);
+	_mm_free(_ang_tri);
+	_mm_free(kupdown);
+	_mm_free(mupdown);
+	_mm_free(stage);
+	_mm_free(st);
+	_mm_free(level);
+	_mm_free(rng);
+	_mm_free(score1);
+	_mm_free(score2);
+	_mm_free(rally);
+	_mm_free(rallyTotal);
+	_mm_free(levelTotal);
+}
+
+void MatchBatch::step() {
+	for (int i = 0; i < padded; i += WIDTH) {
+		vr bx = loadr(ballx + i);
+		vr by = loadr(bally + i);
+		vr px = loadr(prevx + i);
+		vr py = loadr(prevy + i);
+		vr xs = loadr(xspeed + i);
+		vr ys = loadr(yspeed + i);
+		vr sx = loadr(storex + i);
+		vr xb = loadr(xbot + i);
+		vr xt = loadr(xtop + i);
+		vf angle = loadf(_angle + i);
+		vf angTri = loadf(_ang_tri + i);
+		vi stg = loadi(stage + i);
+		vi lvl = loadi(level + i);
+
+		//One xorshift32 draw per tick; each random choice uses its own bits
+		vi r = loadi((const int*)rng + i);
+		r = xori(r, shl(r, 13));
+		r = xori(r, shr(r, 17));
+		r = xori(r, shl(r, 5));
+		storei((int*)rng + i, r);
+
+		angle = add(angle, set(20));
+		angle = sel(gt(angle, set(360)), sub(angle, set(360)), angle);
+		angTri = add(angTri, set(5));
+		angTri = sel(gt(angTri, set(360)), sub(angTri, set(360)), angTri);
+
+		//Serve
+		vf serve = eqi(loadi(st + i), seti(0));
+		angTri = sel(serve, set(31), angTri);
+		xs = sel(serve, real(0), xs);
+		ys = sel(serve, sel(even(r, 0), real(.15f), real(-.15f)), ys);
+		storei(st + i, seti(1));
+
+		vf stage1 = eqi(stg, seti(1));
+		vf stage2 = eqi(stg, seti(2));
+		//Most ticks no match is near anything; the collider blocks are skipped
+		//unless at least one lane needs them
+		vr x;
+		vf over;
+		vf centerLine = crossesBand(px, py, bx, by, -.1f, .1f, x, over);
+		if (any(centerLine)) {
+			vf rightFan = band(stage1, centerLine, le(x, real(6.8f + 1.4f)), ge(x, real(6.8f - 1.4f)));
+			vf leftFan = band(stage1, centerLine, le(x, real(-6.8f + 1.4f)), ge(x, real(-6.8f - 1.4f)));
+			vf middleFan = band(stage2, centerLine, le(x, real(2.5f)), ge(x, real(-2.5f)));
+			fanEffect(rightFan, r, x, xs, ys, sx, lvl, 6.8f, .5f, false);
+			fanEffect(leftFan, r, x, xs, ys, sx, lvl, -6.8f, .5f, false);
+			fanEffect(middleFan, r, x, xs, ys, sx, lvl, 0, 1, true);
+
+			vf barrier = band(band(stage1, centerLine, barrierClosed(angTri)), le(x, real(14)), ge(x, real(-14)));
+			vr stored = sel(eq(sx, real(0)), sel(even(r, 3), real(.12f), real(-.12f)),
+				sel(even(r, 3), sx, neg(sx)));
+			vf xzero = eq(xs, real(0));
+			vr bounced = sel(xzero, stored, sel(even(r, 4), neg(xs), xs));
+			xs = sel(barrier, bounced, xs);
+			ys = sel(barrier, neg(ys), ys);
+			by = sel(band(barrier, over), neg(by), by);
+		}
+
+		vf ends = gt(absf(by), real(7.6f));
+		if (any(ends)) {
+			//Top 24 bits of the draw scaled to 0..2, then + 1 as in rand() % 3 + 1
+			vi choice = addi(toint(mul(tofloat(shr(r, 8)), set(3.0f / 16777216.0f))), seti(1));
+			vf bottom = band(crossesBand(px, py, bx, by, -7.8f, -7.6f, x, over),
+				le(x, add(xb, real(2))), ge(x, sub(xb, real(2))));
+			paddleEffect(bottom, loadi(kupdown + i), choice, xs, ys, sx);
+			by = sel(band(bottom, over), sub(real(-7.7f * 2), by), by);
+			vf top = band(crossesBand(px, py, bx, by, 7.6f, 7.8f, x, over),
+				le(x, add(xt, real(2))), ge(x, sub(xt, real(2))));
+			paddleEffect(top, loadi(mupdown + i), choice, xs, ys, sx);
+			by = sel(band(top, over), sub(real(7.7f * 2), by), by);
+		}
+
+		//Points
+		vf up = gt(by, real(8.3f));
+		vf down = lt(by, real(-8.3f));
+		vf scored = bor(up, down);
+		vi rl = addi(loadi(rally + i), seti(1));
+		if (!any(scored)) {
+			storei(rally + i, rl);
+		}
+		else {
+			storei(score1 + i, subi(loadi(score1 + i), maski(up)));
+			storei(score2 + i, subi(loadi(score2 + i), maski(down)));
+			storei(rallyTotal + i, addi(loadi(rallyTotal + i), andi(rl, maski(scored))));
+			storei(levelTotal + i, addi(loadi(levelTotal + i), andi(lvl, maski(scored))));
+			storei(rally + i, seli(scored, seti(0), rl));
+			storei(st + i, seli(scored, seti(0), loadi(st + i)));
+			bx = sel(scored, real(0), bx);
+			by = sel(scored, sel(stage2, real(0), real(.1f)), by);
+			xt = sel(scored, real(0), xt);
+			xb = sel(scored, real(0), xb);
+			lvl = seli(scored, seti(0), lvl);
+			sx = sel(scored, real(0), sx);
+			stg = seli(scored, subi(seti(3), stg), stg);
+			stage1 = eqi(stg, seti(1));
+			stage2 = eqi(stg, seti(2));
+		}
+
+		//A match that scored sits out the move, like step() while paused
+		px = bx;
+		py = by;
+		by = sel(scored, by, add(by, ys));
+		bx = sel(scored, bx, add(bx, xs));
+
+		//Stage 2 walls wrap around in the middle and bounce near the corners
+		vf gap = band(gt(by, real(-4.5f)), lt(by, real(4.5f)));
+		vf leftOut = lt(bx, real(-9.8f));
+		vf rightOut = gt(bx, real(9.8f));
+		vf wrap = band(stage2, gap);
+		bx = sel(band(wrap, leftOut), sub(neg(bx), real(.1f)), bx);
+		bx = sel(band(wrap, rightOut), add(neg(bx), real(.1f)), bx);
+		px = sel(band(wrap, bor(leftOut, rightOut)), sub(bx, xs), px);
+		vf bounce = andnot(gap, band(stage2, bor(leftOut, rightOut)));
+		bounce = bor(bounce, band(stage1, bor(gt(bx, real(9.4f)), lt(bx, real(-9.4f)))));
+		xs = sel(bounce, neg(xs), xs);
+
+		storer(ballx + i, bx);
+		storer(bally + i, by);
+		storer(prevx + i, px);
+		storer(prevy + i, py);
+		storer(xspeed + i, xs);
+		storer(yspeed + i, ys);
+		storer(storex + i, sx);
+		storer(xbot + i, xb);
+		storer(xtop + i, xt);
+		storef(_angle + i, angle);
+		storef(_ang_tri + i, angTri);
+		storei(stage + i, stg);
+		storei(level + i, lvl);
+	}
+}
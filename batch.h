@@ -0,0 +1,67 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include "fixed.h"
+
+//Many independent matches advanced together, one match per SIMD lane.  The
+//rules are the same as step() in game.cpp, with the branches turned into
+//masked lane operations (AVX2 when compiled with it, SSE2 otherwise).
+//
+//Differences from step():
+// - paused matches are served straight away, as there is no one to press 'p'
+// - random choices come from a per-match xorshift stream instead of rand()
+// - the .01 speed-ups are done in float rather than double, so results can
+//   differ from step() in the last bit
+// - the numbers are always the default GameParams, on the built-in level
+//
+//With FIXED_POINT the Real lanes are 16.16 integers, so a batch comes out the
+//same on every machine and at every register width.
+class MatchBatch {
+public:
+	//Lanes per SIMD register in this build
+	static const int LANES;
+
+	MatchBatch(int count, unsigned int seed);
+	~MatchBatch();
+
+	//Number of matches; the arrays are padded up to a multiple of LANES
+	int size() const {
+		return count;
+	}
+
+	//Advances every match by one tick
+	void step();
+
+	//Ball and paddles, one entry per match
+	Real* ballx;
+	Real* bally;
+	Real* prevx;
+	Real* prevy;
+	Real* xspeed;
+	Real* yspeed;
+	Real* storex;
+	Real* xbot;
+	Real* xtop;
+	float* _angle;
+	float* _ang_tri;
+	int* kupdown;
+	int* mupdown;
+	int* stage;
+	int* st;
+	int* level;
+	unsigned int* rng;
+
+	//Results, one entry per match
+	int* score1;
+	int* score2;
+	int* rally;      //Ticks since the current serve
+	int* rallyTotal; //Sum of the rally lengths of all points so far
+	int* levelTotal; //Sum of the levels reached at all points so far
+private:
+	int count;
+	int padded;
+
+	MatchBatch(const MatchBatch &);
+	void operator=(const MatchBatch &);
+};
+
+#endif
@@ -0,0 +1,171 @@
+//Offscreen render benchmark.  Draws frames the way display() does into an
+//EGL pbuffer, so it needs no window and no GPU (Mesa falls back to
+//llvmpipe), and reports how fast and how many GL calls per frame.
+//	g++ -O2 -mssse3 -std=c++11 -pthread -DCOUNT_GL_CALLS -o dxball_bench bench.cpp render.cpp glstate.cpp imageloader.cpp mappedfile.cpp game.cpp level.cpp multiball.cpp -lEGL -lGLU -lGL
+//	dxball_bench [frames per stage] [balls]
+//With balls, that many extra balls of multi-ball mode are drawn as well.
+//Run it from the directory with the bitmaps.  The image hash printed for each
+//stage changes only if what is drawn changes.
+#include<iostream>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include "game.h"
+#include "render.h"
+#include "multiball.h"
+#include "glstate.h"
+#ifdef COUNT_GL_CALLS
+#include "glcount.h"
+#endif
+using namespace std;
+
+const int WIDTH = 900;
+const int HEIGHT = 700;
+
+//Makes a WIDTH x HEIGHT pbuffer with a compatibility-profile context current
+bool makeContext()
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	if (getPlatformDisplay != NULL)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		return false;
+
+	const EGLint attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 24,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, attributes, &config, 1, &configs) || configs == 0)
+		return false;
+	if (!eglBindAPI(EGL_OPENGL_API))
+		return false;
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	const EGLint size[] = { EGL_WIDTH, WIDTH, EGL_HEIGHT, HEIGHT, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, size);
+	if (context == EGL_NO_CONTEXT || surface == EGL_NO_SURFACE)
+		return false;
+	return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+}
+
+//Moves the ball, paddles and fans along a fixed path, so every run draws the
+//same frames
+void script(GameState &game, int frame)
+{
+	float t = frame * .05f;
+	game.ballx = 8 * sinf(t * 1.3f);
+	game.bally = 7.5f * sinf(t * .7f);
+	game.xbot = 7 * sinf(t);
+	game.xtop = -7 * sinf(t * 1.1f);
+	game.kupdown = (frame / 40) % 3 - 1;
+	game.mupdown = (frame / 50) % 3 - 1;
+	game._angle = (float)((frame * 20) % 360);
+	game._ang_tri = (float)((frame * 5) % 360);
+}
+
+//FNV-1a of the pixels in the pbuffer
+unsigned int imageHash()
+{
+	vector<unsigned char> pixels(WIDTH * HEIGHT * 4);
+	glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < pixels.size(); i++)
+		hash = (hash ^ pixels[i]) * 16777619u;
+	return hash;
+}
+
+void runStage(GameState &game, int stage, int frames, int ballCount)
+{
+	game.stage = stage;
+	MultiBall balls(ballCount, 1);
+#ifdef COUNT_GL_CALLS
+	for (int i = 0; i < GLC_CALLS; i++)
+		glCallCounts[i] = 0;
+#endif
+	GLStateCounts stateBegin = glState.counts;
+	clock_t cpuBegin = clock();
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		script(game, frame);
+		//As display() does
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glState.matrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		BatBall(game);
+		if (ballCount > 0) {
+			GameState serving = game;
+			serving.pause = 0; //The script leaves the match waiting to serve
+			balls.step(serving);
+			drawBalls(game, balls, 1);
+		}
+		glFinish();
+		glState.endFrame();
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	double cpu = (double)(clock() - cpuBegin) / CLOCKS_PER_SEC;
+
+	cout << "Stage " << stage;
+	if (ballCount > 0)
+		cout << " with " << ballCount << " balls";
+	cout << ": " << frames << " frames in " << seconds << " s, "
+		<< frames / seconds << " frames per second\n";
+	cout << "  " << seconds * 1000 / frames << " ms per frame, " << cpu * 1000 / frames
+		<< " ms CPU per frame (all threads)\n";
+#ifdef COUNT_GL_CALLS
+	long total = 0;
+	for (int i = 0; i < GLC_CALLS; i++)
+		total += glCallCounts[i];
+	cout << "  " << (double)total / frames << " GL calls per frame:";
+	for (int i = 0; i < GLC_CALLS; i++) {
+		if (glCallCounts[i] != 0)
+			cout << " " << glCallNames[i] << " " << (double)glCallCounts[i] / frames;
+	}
+	cout << "\n";
+#endif
+	static const char* stateNames[GLS_CALLS] = { "glEnable", "glDisable", "glEnableClientState",
+		"glDisableClientState", "glBindTexture", "glMaterialfv", "glColor3f", "glMatrixMode" };
+	cout << "  State calls per frame, issued/elided:";
+	for (int i = 0; i < GLS_CALLS; i++) {
+		cout << " " << stateNames[i] << " " << (double)(glState.counts.issued[i] - stateBegin.issued[i]) / frames
+			<< "/" << (double)(glState.counts.elided[i] - stateBegin.elided[i]) / frames;
+	}
+	cout << "\n";
+	cout << "  image hash " << hex << imageHash() << dec << "\n";
+}
+
+int main(int argc, char** argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 500;
+	int balls = argc > 2 ? atoi(argv[2]) : 0;
+	if (frames <= 0 || balls < 0) {
+		cerr << "usage: dxball_bench [frames per stage] [balls]\n";
+		return 1;
+	}
+	if (!makeContext()) {
+		cerr << "Could not make an offscreen EGL context\n";
+		return 1;
+	}
+	cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+
+	GameState game;
+	init(game);
+	finishTextures(); //Stage 2's too, so neither stage's frames count uploads
+	reshape(WIDTH, HEIGHT);
+	runStage(game, 1, frames, balls);
+	runStage(game, 2, frames, balls);
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "bot.h"
+
+namespace {
+	const double PADDLE_LINE = 7.7;
+	const double PADDLE_LIMIT = 8.6;
+	const double STEP = .6;       //How far the bot moves its paddle per tick
+	const long LOOKAHEAD = 400;   //Ticks; a .15 ball crosses the field in about 100
+	//Events looked at per prediction at most, which keeps a decision well
+	//under 50 us.  Most predictions take fewer than 10; a slow ball
+	//crawling through the centre line can take over 150, and is far enough
+	//off that following it until it is nearer does as well.
+	const int MAX_EVENTS = 24;
+	const double OUT_OF_PLAY = 100; //Where the bot's own paddle is put in the copy
+
+	//Moves a paddle one input at a time
+	const InputType LEFT[2] = { INPUT_BOTTOM_LEFT, INPUT_TOP_LEFT };
+	const InputType RIGHT[2] = { INPUT_BOTTOM_RIGHT, INPUT_TOP_RIGHT };
+	const double INPUT_MOVE[2] = { .6, .1 };
+	//Raise and lower the tilt by one
+	const InputType TILT_UP[2] = { INPUT_BOTTOM_UP, INPUT_TOP_TILT_RIGHT };
+	const InputType TILT_DOWN[2] = { INPUT_BOTTOM_DOWN, INPUT_TOP_TILT_LEFT };
+
+	//Whether the ball's last move crossed y = line, and where
+	bool crossed(const GameState &s, double line, double &x) {
+		double y0 = toDouble(s.prevy);
+		double y1 = toDouble(s.bally);
+		if ((y0 - line) * (y1 - line) > 0 || y0 == y1)
+			return false;
+		double x0 = toDouble(s.prevx);
+		x = x0 + (toDouble(s.ballx) - x0) * (line - y0) / (y1 - y0);
+		return true;
+	}
+}
+
+bool predictCrossing(const GameState &state, Side side, double &x) {
+	if (state.pause != 0)
+		return false;
+	double line = side == SIDE_BOTTOM ? -PADDLE_LINE : PADDLE_LINE;
+	GameState future = state;
+	//The bot's own paddle is moved out of the way so the ball flies through
+	//its line instead of bouncing off wherever the paddle happens to be
+	if (side == SIDE_BOTTOM)
+		future.xbot = OUT_OF_PLAY;
+	else future.xtop = OUT_OF_PLAY;
+	//stepToEvent() by hand: the last move skipped ends in the paddle band,
+	//so it is looked at as well as each move step() makes
+	long end = state.tick + LOOKAHEAD;
+	for (int events = 0; events < MAX_EVENTS && future.tick < end; events++) {
+		long quiet = quietTicks(future);
+		skipTicks(future, quiet < end - future.tick ? quiet : end - future.tick);
+		if (crossed(future, line, x))
+			return true;
+		if (step(future, Inputs()))
+			return false;
+		if (crossed(future, line, x))
+			return true;
+	}
+	return false;
+}
+
+void botInputs(const GameState &state, Side side, Inputs &inputs) {
+	if (state.pause != 0)
+		return;
+	double target;
+	if (!predictCrossing(state, side, target))
+		target = toDouble(state.ballx); //Nothing better to do than follow the ball
+	if (target > PADDLE_LIMIT)
+		target = PADDLE_LIMIT;
+	if (target < -PADDLE_LIMIT)
+		target = -PADDLE_LIMIT;
+
+	double paddle = toDouble(side == SIDE_BOTTOM ? state.xbot : state.xtop);
+	double move = target - paddle;
+	if (move > STEP)
+		move = STEP;
+	if (move < -STEP)
+		move = -STEP;
+	int steps = (int)(move / INPUT_MOVE[side] + (move < 0 ? -.5 : .5));
+	for (int i = 0; i < steps; i++)
+		inputs.push(RIGHT[side]);
+	for (int i = 0; i > steps; i--)
+		inputs.push(LEFT[side]);
+
+	//A negative tilt sends the ball right, a positive one left; aim at the
+	//side of the field the other paddle is not on
+	double other = toDouble(side == SIDE_BOTTOM ? state.xtop : state.xbot);
+	int tilt = other > 0 ? 1 : -1;
+	int current = side == SIDE_BOTTOM ? state.kupdown : state.mupdown;
+	for (; current < tilt; current++)
+		inputs.push(TILT_UP[side]);
+	for (; current > tilt; current--)
+		inputs.push(TILT_DOWN[side]);
+}
@@ -0,0 +1,28 @@
+#ifndef BOT_H
+#define BOT_H
+
+//Computer players for either paddle, for attract mode, solo play and load
+//tests.  A bot plays the match forward on a copy of the state with the
+//event stepper to find where the ball will next cross its paddle line.  The
+//copy follows the walls, the stage 2 wrap, the barrier and the fans exactly,
+//random deflections included, as those come from the match's own random
+//stream.  It then moves there as fast as a player could and tilts the paddle
+//to send the ball away from the other paddle.
+#include "game.h"
+
+enum Side {
+	SIDE_BOTTOM, //xbot/kupdown, the arrow keys
+	SIDE_TOP     //xtop/mupdown, the mouse
+};
+
+//Where the ball will next cross side's paddle line (y = -7.7 or 7.7),
+//assuming the other paddle stays where it is.  False if the match is paused
+//or the ball will not get there within a few seconds (e.g. the other side
+//misses) or a couple of dozen contacts, whichever comes first.
+bool predictCrossing(const GameState &state, Side side, double &x);
+
+//Adds the inputs side's bot makes before the next tick to inputs: at most
+//one .6 step of the paddle, the pace of a held arrow key, and a tilt.
+void botInputs(const GameState &state, Side side, Inputs &inputs);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+//Number type for the ball and paddles in the simulation.  By default it is
+//float.  Built with -DFIXED_POINT it is Fixed, a 16.16 fixed-point number:
+//every operation the simulation does on it is an exact integer operation, so
+//a match comes out bit for bit the same whatever the compiler, flags (FMA
+//contraction, x87, -ffast-math) or machine.  Every file that includes
+//game.h must be built with the same setting.
+
+//16.16 fixed point, in the range -32768 to 32768 with steps of 1/65536.
+//Only what the simulation needs: adding, negating and comparing.
+class Fixed {
+public:
+	Fixed() : raw(0) {
+	}
+
+	//Rounds to the nearest step.  Implicit, so the constants in the rules
+	//(8.6, .01, ...) can be written as they are for floats.  Scaling by a
+	//power of two is exact, so this rounds the same everywhere.
+	Fixed(double d) : raw((int)(d * 65536 + (d < 0 ? -.5 : .5))) {
+	}
+
+	static Fixed fromRaw(int raw) {
+		Fixed f;
+		f.raw = raw;
+		return f;
+	}
+
+	int raw;
+};
+
+inline Fixed operator+(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw + b.raw); }
+inline Fixed operator-(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw - b.raw); }
+inline Fixed operator-(Fixed a) { return Fixed::fromRaw(-a.raw); }
+inline bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+inline bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+inline bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+inline bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+inline bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+inline bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+
+inline double toDouble(Fixed f) { return f.raw / 65536.0; }
+inline float toFloat(Fixed f) { return (float)(f.raw / 65536.0); }
+inline double toDouble(float f) { return f; }
+inline float toFloat(float f) { return f; }
+
+#ifdef FIXED_POINT
+typedef Fixed Real;
+#else
+typedef float Real;
+#endif
+
+#endif
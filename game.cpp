@@ -0,0 +1,610 @@
+#include "game.h"
+#include "level.h"
+#include <math.h>
+#include <string.h>
+
+GameParams::GameParams() : serveSpeed(.15), sideSpeed(.12), fanSpeedUp(.01), level(&Level::builtIn()) {
+
+}
+
+namespace {
+	const GameParams DEFAULT_PARAMS;
+}
+
+GameState::GameState(unsigned int seed, const GameParams* params_) : level(0), score1(0), score2(0), _angle(0),
+	_ang_tri(0), xbot(0), xtop(0), ballx(0), bally(0), prevx(0), prevy(0), xspeed(0), yspeed(0),
+	st(0), storex(0), pause(0), stage(1), kupdown(0), mupdown(0), tick(0), rng(seed != 0 ? seed : 1),
+	params(params_ != 0 ? params_ : &DEFAULT_PARAMS) {
+
+}
+
+unsigned int matchSeed(unsigned int seed, unsigned long index) {
+	//splitmix32
+	unsigned int z = seed + 0x9e3779b9u * (unsigned int)(index + 1);
+	z = (z ^ (z >> 16)) * 0x85ebca6bu;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+	z = z ^ (z >> 16);
+	return z != 0 ? z : 1;
+}
+
+namespace {
+	//FNV-1a, one 32 bit word at a time
+	unsigned int mix(unsigned int hash, unsigned int word) {
+		for (int i = 0; i < 4; i++)
+			hash = (hash ^ ((word >> (8 * i)) & 0xff)) * 16777619u;
+		return hash;
+	}
+
+	unsigned int mix(unsigned int hash, float f) {
+		unsigned int bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return mix(hash, bits);
+	}
+
+#ifdef FIXED_POINT
+	unsigned int mix(unsigned int hash, Fixed f) {
+		return mix(hash, (unsigned int)f.raw);
+	}
+#endif
+
+	unsigned int mixBytes(unsigned int hash, const void* data, size_t size) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ p[i]) * 16777619u;
+		return hash;
+	}
+}
+
+unsigned int paramsHash(const GameParams &params) {
+	const LevelHeader &level = params.level->header();
+	unsigned int h = mixBytes(2166136261u, &level, level.size);
+	h = mixBytes(h, &params.serveSpeed, sizeof(params.serveSpeed));
+	h = mixBytes(h, &params.sideSpeed, sizeof(params.sideSpeed));
+	h = mixBytes(h, &params.fanSpeedUp, sizeof(params.fanSpeedUp));
+#ifdef FIXED_POINT
+	return mix(h, 1u);
+#else
+	return mix(h, 0u);
+#endif
+}
+
+unsigned int stateHash(const GameState &s) {
+	unsigned int h = 2166136261u;
+	h = mix(h, (unsigned int)s.level);
+	h = mix(h, (unsigned int)s.score1);
+	h = mix(h, (unsigned int)s.score2);
+	h = mix(h, s._angle);
+	h = mix(h, s._ang_tri);
+	h = mix(h, s.xbot);
+	h = mix(h, s.xtop);
+	h = mix(h, s.ballx);
+	h = mix(h, s.bally);
+	h = mix(h, s.prevx);
+	h = mix(h, s.prevy);
+	h = mix(h, s.xspeed);
+	h = mix(h, s.yspeed);
+	h = mix(h, (unsigned int)s.st);
+	h = mix(h, s.storex);
+	h = mix(h, (unsigned int)s.pause);
+	h = mix(h, (unsigned int)s.stage);
+	h = mix(h, (unsigned int)s.kupdown);
+	h = mix(h, (unsigned int)s.mupdown);
+	h = mix(h, (unsigned int)s.tick);
+	h = mix(h, s.rng);
+	return h;
+}
+
+void applyInput(GameState &s, InputType input) {
+	switch (input) {
+	case INPUT_BOTTOM_LEFT:
+		s.xbot = s.xbot - .6;
+		if (s.xbot < -8.6)
+			s.xbot = -8.6;
+		break;
+	case INPUT_BOTTOM_RIGHT:
+		s.xbot = s.xbot + .6;
+		if (s.xbot > 8.6)
+			s.xbot = 8.6;
+		break;
+	case INPUT_BOTTOM_UP:
+		if (s.kupdown <= 0)
+			s.kupdown = s.kupdown + 1;
+		break;
+	case INPUT_BOTTOM_DOWN:
+		if (s.kupdown >= 0)
+			s.kupdown = s.kupdown - 1;
+		break;
+	case INPUT_TOP_LEFT:
+		if (s.xtop < -8.6)
+			s.xtop = -8.6;
+		else
+			s.xtop = s.xtop - .1;
+		break;
+	case INPUT_TOP_RIGHT:
+		if (s.xtop > 8.6)
+			s.xtop = 8.6;
+		else
+			s.xtop = s.xtop + .1;
+		break;
+	case INPUT_TOP_TILT_LEFT:
+		if (s.mupdown >= 0)
+			s.mupdown = s.mupdown - 1;
+		break;
+	case INPUT_TOP_TILT_RIGHT:
+		if (s.mupdown <= 0)
+			s.mupdown = s.mupdown + 1;
+		break;
+	case INPUT_SPEED_UP:
+		if (s.xspeed > 0) {
+			s.xspeed = s.xspeed + .01;
+		}
+		else if (s.xspeed < 0) {
+			s.xspeed = s.xspeed - .01;
+		}
+		if (s.yspeed > 0)
+			s.yspeed = s.yspeed + .01;
+		else s.yspeed = s.yspeed - .01;
+		break;
+	case INPUT_SPEED_DOWN:
+		if (s.xspeed > 0) {
+			s.xspeed = s.xspeed - .01;
+		}
+		else if (s.xspeed < 0) {
+			s.xspeed = s.xspeed + .01;
+		}
+		if (s.yspeed > 0)
+			s.yspeed = s.yspeed - .01;
+		else s.yspeed = s.yspeed + .01;
+		break;
+	case INPUT_PAUSE:
+		if (s.pause == 0)
+			s.pause = 1;
+		else s.pause = 0;
+		break;
+	case INPUT_STAGE:
+		s.stage = s.stage % s.params->level->stageCount() + 1;
+		break;
+	}
+}
+
+bool barrierClosed(float a, double window) {
+	return (a >= 360 - window && a <= 360) || (a <= window && a >= 0) ||
+		(a <= -(360 - window) && a >= -360) || (a >= -window && a <= 0) ||
+		(a >= 180 - window && a <= 180 + window) || (a <= -(180 - window) && a >= -(180 + window));
+}
+
+namespace {
+	//Replaces rand(), which is shared by the whole process and not thread
+	//safe.  xorshift32, with the low bit dropped to stay non-negative.
+	int nextRandom(GameState &s) {
+		unsigned int x = s.rng;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		s.rng = x;
+		return (int)(x >> 1);
+	}
+
+	//Serves the ball if it is not in play yet
+	void start(GameState &s) {
+		if (s.st == 0) {
+			s._ang_tri = (float)s.params->level->header().barrierServe;
+			s.xspeed = 0;
+			if (nextRandom(s) % 2 == 0)
+				s.yspeed = s.params->serveSpeed;
+			else s.yspeed = -s.params->serveSpeed;
+		}
+		s.st = 1;
+	}
+
+	//x where the move from (px, py) to (bx, by) crosses the line y = mid
+	inline float crossingX(float px, float py, float bx, float by, double mid) {
+		double t = (mid - py) / (by - py);
+		return (float)(px + t * (bx - px));
+	}
+
+	//The same in whole steps of the fixed-point type, rounded towards px
+	inline Fixed crossingX(Fixed px, Fixed py, Fixed bx, Fixed by, double mid) {
+		long long moved = ((long long)Fixed(mid).raw - py.raw) * ((long long)bx.raw - px.raw);
+		return Fixed::fromRaw(px.raw + (int)(moved / ((long long)by.raw - py.raw)));
+	}
+
+	//Swept test of the ball's last move against the band lo < y < hi.  The
+	//move hits if it ended inside the band, as a point test would see, or if
+	//it jumped right over the band, which a fast ball does once it moves
+	//further per tick than the band is thick.  x is where the ball met the
+	//band and over tells the two cases apart.
+	inline bool crossesBand(const GameState &s, double lo, double hi, Real &x, bool &over) {
+		over = false;
+		double y = toDouble(s.bally);
+		double prevy = toDouble(s.prevy);
+		if (y < hi && y > lo) {
+			x = s.ballx;
+			return true;
+		}
+		if (!(prevy >= hi && y <= lo) && !(prevy <= lo && y >= hi))
+			return false;
+		x = crossingX(s.prevx, s.prevy, s.ballx, s.bally, (lo + hi) / 2);
+		over = true;
+		return true;
+	}
+
+	//Deflection by a spinning fan.  The ball is bounced back sideways if it
+	//hits within inner of the hub.  The middle fan of stage 2 also gives a
+	//ball with no sideways speed yet the default sideSpeed.
+	void fanEffect(GameState &s, Real x0, double center, double inner, bool middle) {
+		int x = 0;
+		if (s.xspeed == 0) {
+			if (middle && s.storex == 0) {
+				if (nextRandom(s) % 2 == 0)
+					s.xspeed = -s.params->sideSpeed;
+				else s.xspeed = s.params->sideSpeed;
+			}
+			else if (nextRandom(s) % 2 == 0)
+				s.xspeed = s.storex;
+			else s.xspeed = -s.storex;
+		}
+		else if (nextRandom(s) % 2 == 0) {
+			s.xspeed = -s.xspeed;
+			x = 1;
+		}
+		else if (s.yspeed < 0 && s.xspeed < 0) {
+			s.xspeed = s.xspeed - s.params->fanSpeedUp;
+			s.yspeed = s.yspeed - s.params->fanSpeedUp;
+			s.level = s.level + 1;
+		}
+		else if (s.yspeed > 0 && s.xspeed < 0) {
+			s.xspeed = s.xspeed - s.params->fanSpeedUp;
+			s.yspeed = s.yspeed + s.params->fanSpeedUp;
+			s.level = s.level + 1;
+		}
+		else if (s.yspeed > 0 && s.xspeed > 0) {
+			s.xspeed = s.xspeed + s.params->fanSpeedUp;
+			s.yspeed = s.yspeed + s.params->fanSpeedUp;
+			s.level = s.level + 1;
+		}
+		else if (s.yspeed < 0 && s.xspeed > 0) {
+			s.xspeed = s.xspeed + s.params->fanSpeedUp;
+			s.yspeed = s.yspeed - s.params->fanSpeedUp;
+			s.level = s.level + 1;
+		}
+		if (x == 0 && (x0 <= center + inner && x0 >= center - inner))
+			s.xspeed = -s.xspeed;
+	}
+
+	//Bounce off the barrier, turned flat
+	void barrierEffect(GameState &s, bool over) {
+		s.yspeed = -s.yspeed;
+		if (over)
+			s.bally = -s.bally; //Back to the side it came from
+		if (s.xspeed == 0) {
+			if (s.storex == 0) {
+				if (nextRandom(s) % 2 == 0)
+					s.xspeed = s.params->sideSpeed;
+				else s.xspeed = -s.params->sideSpeed;
+			}
+			else if (nextRandom(s) % 2 == 0)
+				s.xspeed = s.storex;
+			else s.xspeed = -s.storex;
+		}
+		else if (nextRandom(s) % 2 == 0)
+			s.xspeed = -s.xspeed;
+	}
+
+	//Whether the ball at (x, y) is on the far side of a wall or wrap's line
+	//and within its stretch of y
+	inline bool pastWall(const LevelObstacle &o, Real x, Real y) {
+		if (o.kind == OBSTACLE_WRAP ? !(y > o.lo && y < o.hi) : !(y >= o.lo && y <= o.hi))
+			return false;
+		return o.x < 0 ? x < o.x : x > o.x;
+	}
+
+	//Bounce off a paddle.  A negative tilt sends the ball right, a positive
+	//one sends it left, a flat paddle either reverses or kills the sideways
+	//speed at random.
+	void paddleEffect(GameState &s, int tilt) {
+		int x = nextRandom(s) % 3 + 1;
+		if (tilt < 0) {
+			if (s.xspeed > 0) {
+			}
+			else if (s.xspeed < 0) {
+				s.xspeed = -s.xspeed;
+			}
+			else if (s.xspeed == 0 && s.storex == 0) {
+				s.xspeed = s.params->sideSpeed;
+			}
+			else if (s.xspeed == 0 && s.storex > 0) {
+				s.xspeed = s.storex;
+			}
+			else if (s.xspeed == 0 && s.storex < 0) {
+				s.xspeed = -s.storex;
+			}
+		}
+		else if (tilt == 0) {
+			if (s.xspeed == 0) {
+
+				if (x == 1) {
+					if (s.storex == 0)
+						s.xspeed = -s.params->sideSpeed;
+					else if (s.storex > 0)
+						s.xspeed = -s.storex;
+					else s.xspeed = s.storex;
+				}
+				else if (x == 2) {
+					if (s.storex == 0)
+						s.xspeed = s.params->sideSpeed;
+					else if (s.storex > 0)
+						s.xspeed = s.storex;
+					else s.xspeed = -s.storex;
+				}
+			}
+			else if (x == 1)
+				s.xspeed = -s.xspeed;
+			else if (x == 2) {
+				s.storex = s.xspeed;
+				s.xspeed = 0;
+			}
+		}
+		else if (tilt > 0) {
+			if (s.xspeed < 0) {
+			}
+			else if (s.xspeed > 0) {
+				s.xspeed = -s.xspeed;
+			}
+			else if (s.xspeed == 0 && s.storex == 0) {
+				s.xspeed = -s.params->sideSpeed;
+			}
+			else if (s.xspeed == 0 && s.storex > 0) {
+				s.xspeed = -s.storex;
+			}
+			else if (s.xspeed == 0 && s.storex < 0) {
+				s.xspeed = s.storex;
+			}
+		}
+		s.yspeed = -s.yspeed;
+	}
+}
+
+bool step(GameState &s, const Inputs &inputs, PointRecord* point) {
+	bool scored = false;
+	const Level &level = *s.params->level;
+	for (int i = 0; i < inputs.count; i++)
+		applyInput(s, (InputType)inputs.types[i]);
+
+	if (s.pause == 0) {
+		s._angle += level.header().fanTurn;
+		if (s._angle > 360) {
+			s._angle -= 360;
+		}
+		s._ang_tri += level.header().barrierTurn;
+		if (s._ang_tri > 360) {
+			s._ang_tri -= 360;
+		}
+	}
+	start(s);
+
+	Real x;
+	bool over;
+	bool centerLine = crossesBand(s, -.1, .1, x, over);
+	const LevelObstacle* obstacles = level.obstacles(s.stage);
+	int count = level.stage(s.stage).obstacles;
+	for (int i = 0; centerLine && i < count; i++) {
+		const LevelObstacle &o = obstacles[i];
+		if (o.kind == OBSTACLE_FAN && x <= o.x + o.reach && x >= o.x - o.reach)
+			fanEffect(s, x, o.x, o.inner, (o.flags & FAN_SIDEWAYS) != 0);
+		else if (o.kind == OBSTACLE_BARRIER && x <= o.x + o.reach && x >= o.x - o.reach &&
+			barrierClosed(s._ang_tri, o.inner))
+			barrierEffect(s, over);
+	}
+
+	if (crossesBand(s, -7.8, -7.6, x, over) && x <= s.xbot + 2 && x >= s.xbot - 2) {
+		paddleEffect(s, s.kupdown); //Bottom player
+		if (over)
+			s.bally = -7.7 * 2 - s.bally;
+	}
+	if (crossesBand(s, 7.6, 7.8, x, over) && x <= s.xtop + 2 && x >= s.xtop - 2) {
+		paddleEffect(s, s.mupdown); //Top player
+		if (over)
+			s.bally = 7.7 * 2 - s.bally;
+	}
+
+	if (s.bally > 8.3 || s.bally < -8.3) //Point scored, reset
+	{
+		if (s.bally > 8.3)
+			s.score1 = s.score1 + 1;
+		else s.score2 = s.score2 + 1;
+		if (point != 0) {
+			point->scorer = s.bally > 8.3 ? 1 : 2;
+			point->score1 = s.score1;
+			point->score2 = s.score2;
+			point->xspeed = toFloat(s.xspeed);
+			point->yspeed = toFloat(s.yspeed);
+			point->level = s.level;
+			point->stage = s.stage;
+		}
+		scored = true;
+		int next = s.stage % level.stageCount() + 1;
+		s.ballx = 0;
+		s.bally = level.stage(next).serveY;
+		s.st = 0;
+		s.xtop = 0;
+		s.xbot = 0;
+		s.level = 0;
+		s.storex = 0;
+		s.pause = 1;
+		s.stage = next;
+	}
+	s.prevx = s.ballx;
+	s.prevy = s.bally;
+	if (s.pause == 0) {
+		s.bally = s.bally + s.yspeed;
+		s.ballx = s.ballx + s.xspeed;
+	}
+
+	//Walls, tested after the move.  A wrap takes the ball round to the other
+	//side instead of any wall.
+	obstacles = level.obstacles(s.stage);
+	count = level.stage(s.stage).obstacles;
+	bool wrapped = false;
+	for (int i = 0; i < count && !wrapped; i++) {
+		const LevelObstacle &o = obstacles[i];
+		if (o.kind == OBSTACLE_WRAP && pastWall(o, s.ballx, s.bally)) {
+			s.ballx = -s.ballx;
+			if (o.x < 0)
+				s.ballx = s.ballx - o.inner;
+			else s.ballx = s.ballx + o.inner;
+			s.prevx = s.ballx - s.xspeed;
+			wrapped = true;
+		}
+	}
+	for (int i = 0; i < count && !wrapped; i++) {
+		if (obstacles[i].kind == OBSTACLE_WALL && pastWall(obstacles[i], s.ballx, s.bally))
+			s.xspeed = -s.xspeed;
+	}
+	s.tick++;
+	return scored;
+}
+
+namespace {
+	//Horizontal bands where a tick can do more than move the ball, from the
+	//bottom up: scoring line, bottom paddle, centre line, top paddle, scoring
+	//line.  A little wider than the real tests, to stay on the safe side.
+	const double ZONES[][2] = {
+		{ -1e30, -8.3 }, { -7.8, -7.6 }, { -.1, .1 }, { 7.6, 7.8 }, { 8.3, 1e30 }
+	};
+	const int CENTER_ZONE = 2;
+
+	//Distances are worked out in double while step() adds up floats.  Over
+	//MAX_SKIP ticks the two drift apart by less than DRIFT, which is kept
+	//clear of every edge.
+	const long MAX_SKIP = 1000;
+	const double DRIFT = 1e-3;
+
+	//Index of the gap below ZONES[i] that y lies in, or -1 if y is in a zone
+	int gapOf(double y) {
+		int i = 0;
+		while (y > ZONES[i][1])
+			i++;
+		return y >= ZONES[i][0] ? -1 : i;
+	}
+
+	//Angle after n ticks of turning by per degrees, wrapped the way step()
+	//does it.  The angles are whole numbers, so this is exact.
+	float advanceAngle(float a, double per, long n) {
+		double b = a + per * n;
+		if (b > 360)
+			b -= 360 * ceil((b - 360) / 360);
+		return (float)b;
+	}
+
+	//Whether the ball can cross the centre line, entering it j ticks from now,
+	//without anything happening: away from the fans, with the barrier turned
+	//open for every tick it spends in the line.  Allows a tick either way for
+	//rounding.
+	bool centerQuiet(const GameState &s, long j) {
+		double width = ZONES[CENTER_ZONE][1] - ZONES[CENTER_ZONE][0] + 2 * DRIFT;
+		double inside = ceil(width / fabs(toDouble(s.yspeed)));
+		if (inside > 100)
+			return false; //Too slow to be worth it
+		long last = j + (long)inside + 1;
+		double x0 = toDouble(s.ballx) + toDouble(s.xspeed) * (j - 1);
+		double x1 = toDouble(s.ballx) + toDouble(s.xspeed) * last;
+		double lo = (x0 < x1 ? x0 : x1) - .01;
+		double hi = (x0 < x1 ? x1 : x0) + .01;
+		const Level &level = *s.params->level;
+		const LevelObstacle* obstacles = level.obstacles(s.stage);
+		for (int i = 0; i < level.stage(s.stage).obstacles; i++) {
+			const LevelObstacle &o = obstacles[i];
+			if (o.kind != OBSTACLE_FAN && o.kind != OBSTACLE_BARRIER)
+				continue;
+			if (hi < o.x - o.reach || lo > o.x + o.reach)
+				continue;
+			if (o.kind == OBSTACLE_FAN)
+				return false;
+			for (long t = j - 1; t <= last; t++) {
+				if (barrierClosed(advanceAngle(s._ang_tri, level.header().barrierTurn, t + 1), o.inner))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+long quietTicks(const GameState &s) {
+	if (s.pause != 0 || s.st == 0)
+		return 0;
+	long quiet = MAX_SKIP;
+	double x = toDouble(s.ballx);
+	double y = toDouble(s.bally);
+	double xspeed = toDouble(s.xspeed);
+	double yspeed = toDouble(s.yspeed);
+
+	//Walls are tested after the move, so tick j sees the ball after j + 1 moves
+	//A ball already past either wall (e.g. slowed down while stuck in it) is
+	//sent back on the next tick, whichever way it is going.  Walls are taken
+	//to cover the whole side, at the innermost line.
+	double wall = 1000;
+	const Level &level = *s.params->level;
+	const LevelObstacle* obstacles = level.obstacles(s.stage);
+	for (int i = 0; i < level.stage(s.stage).obstacles; i++) {
+		const LevelObstacle &o = obstacles[i];
+		if ((o.kind == OBSTACLE_WALL || o.kind == OBSTACLE_WRAP) && fabs(o.x) < wall)
+			wall = fabs(o.x);
+	}
+	wall -= DRIFT;
+	if (x > wall || x < -wall)
+		return 0;
+	if (xspeed != 0) {
+		double room = xspeed > 0 ? wall - x : x + wall;
+		double moves = floor(room / fabs(xspeed)) + 1;
+		if (moves - 1 < quiet)
+			quiet = (long)(moves - 1);
+	}
+
+	//Zones are tested on the ball's last move, so tick j sees it after j moves
+	int gap = gapOf(y);
+	if (gap < 0 || gapOf(toDouble(s.prevy)) != gap)
+		return 0;
+	if (yspeed != 0) {
+		int dir = yspeed > 0 ? 1 : -1;
+		int zone = yspeed > 0 ? gap : gap - 1;
+		for (;;) {
+			double edge = yspeed > 0 ? ZONES[zone][0] - DRIFT : ZONES[zone][1] + DRIFT;
+			double j = ceil((edge - y) / yspeed);
+			if (j <= 0)
+				return 0;
+			if (j >= quiet)
+				break;
+			if (zone == CENTER_ZONE && centerQuiet(s, (long)j)) {
+				zone += dir;
+				continue;
+			}
+			quiet = (long)j;
+			break;
+		}
+	}
+	return quiet;
+}
+
+void skipTicks(GameState &s, long ticks) {
+	if (ticks <= 0)
+		return;
+	for (long i = 0; i < ticks; i++) {
+		s.prevx = s.ballx;
+		s.prevy = s.bally;
+		s.bally = s.bally + s.yspeed;
+		s.ballx = s.ballx + s.xspeed;
+	}
+	const LevelHeader &header = s.params->level->header();
+	s._angle = advanceAngle(s._angle, header.fanTurn, ticks);
+	s._ang_tri = advanceAngle(s._ang_tri, header.barrierTurn, ticks);
+	s.tick += ticks;
+}
+
+bool stepToEvent(GameState &s, long maxTicks, PointRecord* point) {
+	if (maxTicks <= 0)
+		return false;
+	long quiet = quietTicks(s);
+	skipTicks(s, quiet < maxTicks - 1 ? quiet : maxTicks - 1);
+	return step(s, Inputs(), point);
+}
@@ -0,0 +1,138 @@
+#ifndef GAME_H
+#define GAME_H
+
+//Game simulation, independent of OpenGL and GLUT.  game.cpp needs only
+//level.cpp and mappedfile.cpp, so matches can be run without a window (see
+//sim.cpp).
+#include "fixed.h"
+
+class Level; //level.h
+
+//The numbers the rules are balanced with, and the stages they are played
+//on.  GameParams() gives the game's own; dxball_tune tries others.  The
+//level's turns should stay whole degrees, or stepToEvent() can drift from
+//step().
+struct GameParams {
+	GameParams();
+
+	double serveSpeed;     //yspeed of a serve, up or down
+	double sideSpeed;      //xspeed a fan, paddle or the barrier gives a ball with none
+	double fanSpeedUp;     //Added to both speeds by a fan that does not flip the ball
+	const Level* level;    //Fans, barriers and walls of every stage; never null
+};
+
+//Everything one match needs between ticks
+struct GameState {
+	//params (the defaults if null) must outlive the match and its copies
+	GameState(unsigned int seed = 1, const GameParams* params = 0);
+
+	int level;
+	int score1;
+	int score2;
+	float _angle;
+	float _ang_tri;
+	Real xbot, xtop;
+	Real ballx, bally;
+	Real prevx, prevy; //Where the ball was before its last move
+	Real xspeed;
+	Real yspeed;
+	int st;
+	Real storex;
+	int pause;
+	int stage; //From 1, in params->level
+	int kupdown;
+	int mupdown;
+	long tick; //Number of times step() has run
+	unsigned int rng; //State of the match's own random number stream
+	const GameParams* params; //Shared, never null
+};
+
+//Seed for match number index of a run seeded with seed.  Neighbouring
+//matches get unrelated streams.
+unsigned int matchSeed(unsigned int seed, unsigned long index);
+
+//Hash of the rules params sets: the level, the balance numbers and whether
+//the build is fixed point.  Matches with the same seed and inputs play out
+//the same only under rules that hash the same.
+unsigned int paramsHash(const GameParams &params);
+
+//Hash of everything in the state.  Two matches hash the same only if they
+//are in exactly the same state, down to the last bit of every number.
+unsigned int stateHash(const GameState &state);
+
+//One player action, as produced by the keyboard and mouse callbacks
+enum InputType {
+	INPUT_BOTTOM_LEFT,   //GLUT_KEY_LEFT
+	INPUT_BOTTOM_RIGHT,  //GLUT_KEY_RIGHT
+	INPUT_BOTTOM_UP,     //GLUT_KEY_UP
+	INPUT_BOTTOM_DOWN,   //GLUT_KEY_DOWN
+	INPUT_TOP_LEFT,      //Mouse moved left
+	INPUT_TOP_RIGHT,     //Mouse moved right
+	INPUT_TOP_TILT_LEFT, //Left mouse button
+	INPUT_TOP_TILT_RIGHT,//Right mouse button
+	INPUT_SPEED_UP,      //GLUT_KEY_PAGE_UP
+	INPUT_SPEED_DOWN,    //GLUT_KEY_PAGE_DOWN
+	INPUT_PAUSE,         //'p'
+	INPUT_STAGE          //GLUT_KEY_F1
+};
+
+const int MAX_TICK_INPUTS = 16;
+
+//The actions to apply before a tick, in the order they happened
+struct Inputs {
+	Inputs() : count(0) {
+	}
+
+	//Adds an action; returns false if the tick is already full
+	bool push(InputType input) {
+		if (count >= MAX_TICK_INPUTS)
+			return false;
+		types[count++] = (unsigned char)input;
+		return true;
+	}
+
+	int count;
+	unsigned char types[MAX_TICK_INPUTS];
+};
+
+//What the match looked like when a point was scored, before the reset
+struct PointRecord {
+	int scorer; //1 or 2
+	int score1;
+	int score2;
+	float xspeed;
+	float yspeed;
+	int level;
+	int stage;
+};
+
+//Whether the rotating middle barrier, turned to angle (_ang_tri), is flat
+//enough to block the ball: within window degrees of flat
+bool barrierClosed(float angle, double window);
+
+//Applies a single player action to the state
+void applyInput(GameState &state, InputType input);
+
+//Applies the inputs, then advances the match by one 25 ms tick.  Returns
+//true if a point was scored, in which case *point (if given) describes it.
+bool step(GameState &state, const Inputs &inputs, PointRecord* point = 0);
+
+//Event-driven stepping.  Between contacts the ball moves in a straight line
+//and only the fans turn, so the time to the next contact can be worked out
+//and the ticks in between jumped over.  The results are the same as calling
+//step() tick by tick.
+
+//Number of ticks from now that step() would spend only moving the ball and
+//turning the fans: no serve, collision, wall or point.  0 if the very next
+//tick does something, or if the match is paused.
+long quietTicks(const GameState &state);
+
+//Jumps over ticks quiet ticks.  The ball is still moved one addition per
+//tick, as step() rounds it, but nothing else is looked at.
+void skipTicks(GameState &state, long ticks);
+
+//Skips to the next tick where something happens and runs it with step(),
+//advancing at most maxTicks ticks in all.  state.tick tells how many it took.
+bool stepToEvent(GameState &state, long maxTicks, PointRecord* point = 0);
+
+#endif
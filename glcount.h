@@ -0,0 +1,51 @@
+#ifndef GL_COUNT_H
+#define GL_COUNT_H
+
+//Counts the GL calls render.cpp makes, including those glState issues for
+//it.  render.cpp and glstate.cpp include this after the GL headers when
+//built with -DCOUNT_GL_CALLS; each function below is then counted before it
+//is called.  Calls glState elides and calls replayed from display lists
+//are not counted, as they are never submitted.
+
+enum GLCountedCall {
+	GLC_BEGIN, GLC_BIND_TEXTURE, GLC_CALL_LIST, GLC_CLEAR, GLC_COLOR3F,
+	GLC_DISABLE, GLC_DISABLE_CLIENT_STATE, GLC_DRAW_ARRAYS, GLC_ENABLE,
+	GLC_ENABLE_CLIENT_STATE, GLC_END, GLC_LOAD_IDENTITY, GLC_MATERIALFV,
+	GLC_MATRIX_MODE, GLC_NORMAL3FV, GLC_NORMAL_POINTER, GLC_POP_MATRIX,
+	GLC_PUSH_MATRIX, GLC_ROTATEF, GLC_SCALEF, GLC_TEX_COORD2F, GLC_TRANSLATEF,
+	GLC_VERTEX3F, GLC_VERTEX3FV, GLC_VERTEX_POINTER,
+	GLC_CALLS
+};
+
+extern long glCallCounts[GLC_CALLS];
+extern const char* glCallNames[GLC_CALLS];
+
+#define GL_COUNTED(id, call) (glCallCounts[id]++, call)
+
+#define glBegin(...) GL_COUNTED(GLC_BEGIN, glBegin(__VA_ARGS__))
+#define glBindTexture(...) GL_COUNTED(GLC_BIND_TEXTURE, glBindTexture(__VA_ARGS__))
+#define glCallList(...) GL_COUNTED(GLC_CALL_LIST, glCallList(__VA_ARGS__))
+#define glClear(...) GL_COUNTED(GLC_CLEAR, glClear(__VA_ARGS__))
+#define glColor3f(...) GL_COUNTED(GLC_COLOR3F, glColor3f(__VA_ARGS__))
+#define glDisable(...) GL_COUNTED(GLC_DISABLE, glDisable(__VA_ARGS__))
+#define glDisableClientState(...) GL_COUNTED(GLC_DISABLE_CLIENT_STATE, glDisableClientState(__VA_ARGS__))
+#define glDrawArrays(...) GL_COUNTED(GLC_DRAW_ARRAYS, glDrawArrays(__VA_ARGS__))
+#define glEnable(...) GL_COUNTED(GLC_ENABLE, glEnable(__VA_ARGS__))
+#define glEnableClientState(...) GL_COUNTED(GLC_ENABLE_CLIENT_STATE, glEnableClientState(__VA_ARGS__))
+#define glEnd(...) GL_COUNTED(GLC_END, glEnd(__VA_ARGS__))
+#define glLoadIdentity(...) GL_COUNTED(GLC_LOAD_IDENTITY, glLoadIdentity(__VA_ARGS__))
+#define glMaterialfv(...) GL_COUNTED(GLC_MATERIALFV, glMaterialfv(__VA_ARGS__))
+#define glMatrixMode(...) GL_COUNTED(GLC_MATRIX_MODE, glMatrixMode(__VA_ARGS__))
+#define glNormal3fv(...) GL_COUNTED(GLC_NORMAL3FV, glNormal3fv(__VA_ARGS__))
+#define glNormalPointer(...) GL_COUNTED(GLC_NORMAL_POINTER, glNormalPointer(__VA_ARGS__))
+#define glPopMatrix(...) GL_COUNTED(GLC_POP_MATRIX, glPopMatrix(__VA_ARGS__))
+#define glPushMatrix(...) GL_COUNTED(GLC_PUSH_MATRIX, glPushMatrix(__VA_ARGS__))
+#define glRotatef(...) GL_COUNTED(GLC_ROTATEF, glRotatef(__VA_ARGS__))
+#define glScalef(...) GL_COUNTED(GLC_SCALEF, glScalef(__VA_ARGS__))
+#define glTexCoord2f(...) GL_COUNTED(GLC_TEX_COORD2F, glTexCoord2f(__VA_ARGS__))
+#define glTranslatef(...) GL_COUNTED(GLC_TRANSLATEF, glTranslatef(__VA_ARGS__))
+#define glVertex3f(...) GL_COUNTED(GLC_VERTEX3F, glVertex3f(__VA_ARGS__))
+#define glVertex3fv(...) GL_COUNTED(GLC_VERTEX3FV, glVertex3fv(__VA_ARGS__))
+#define glVertexPointer(...) GL_COUNTED(GLC_VERTEX_POINTER, glVertexPointer(__VA_ARGS__))
+
+#endif
@@ -0,0 +1,187 @@
+#include "glstate.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <string.h>
+#ifdef COUNT_GL_CALLS
+#include "glcount.h"
+#endif
+
+GLState glState;
+
+namespace {
+	const GLenum SHADOWED_CAPS[GLState::CAPS] = {
+		GL_TEXTURE_2D, GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_LIGHTING,
+		GL_DEPTH_TEST, GL_COLOR_MATERIAL, GL_NORMALIZE, GL_LIGHT0 };
+
+	const GLenum SHADOWED_MATERIALS[GLState::MATERIALS] = {
+		GL_AMBIENT, GL_DIFFUSE, GL_SPECULAR, GL_EMISSION, GL_SHININESS };
+
+	int capIndex(GLenum cap) {
+		for (int i = 0; i < GLState::CAPS; i++) {
+			if (SHADOWED_CAPS[i] == cap)
+				return i;
+		}
+		return -1;
+	}
+
+	int materialIndex(GLenum pname) {
+		for (int i = 0; i < GLState::MATERIALS; i++) {
+			if (SHADOWED_MATERIALS[i] == pname)
+				return i;
+		}
+		return -1;
+	}
+}
+
+GLStateCounts::GLStateCounts() {
+	for (int i = 0; i < GLS_CALLS; i++) {
+		issued[i] = 0;
+		elided[i] = 0;
+	}
+}
+
+long GLStateCounts::totalIssued() const {
+	long total = 0;
+	for (int i = 0; i < GLS_CALLS; i++)
+		total += issued[i];
+	return total;
+}
+
+long GLStateCounts::totalElided() const {
+	long total = 0;
+	for (int i = 0; i < GLS_CALLS; i++)
+		total += elided[i];
+	return total;
+}
+
+GLState::GLState() {
+	invalidate();
+}
+
+void GLState::invalidate() {
+	for (int i = 0; i < CAPS; i++)
+		caps[i] = UNKNOWN;
+	arrays[0] = arrays[1] = UNKNOWN;
+	texture = UNKNOWN;
+	for (int i = 0; i < MATERIALS; i++)
+		materialKnown[i] = false;
+	colorKnown = false;
+	mode = UNKNOWN;
+}
+
+void GLState::setCap(unsigned int cap, bool on) {
+	int call = on ? GLS_ENABLE : GLS_DISABLE;
+	int i = capIndex(cap);
+	if (i >= 0 && caps[i] == (on ? 1 : 0)) {
+		counts.elided[call]++;
+		return;
+	}
+	if (on)
+		glEnable(cap);
+	else glDisable(cap);
+	counts.issued[call]++;
+	if (i >= 0)
+		caps[i] = on ? 1 : 0;
+	if (cap == GL_COLOR_MATERIAL) {
+		//Turning it on takes the colour into the material
+		materialKnown[0] = materialKnown[1] = false;
+	}
+}
+
+void GLState::enable(unsigned int cap) {
+	setCap(cap, true);
+}
+
+void GLState::disable(unsigned int cap) {
+	setCap(cap, false);
+}
+
+void GLState::setArray(unsigned int array, bool on) {
+	int call = on ? GLS_ENABLE_CLIENT_STATE : GLS_DISABLE_CLIENT_STATE;
+	int i = array == GL_VERTEX_ARRAY ? 0 : array == GL_NORMAL_ARRAY ? 1 : -1;
+	if (i >= 0 && arrays[i] == (on ? 1 : 0)) {
+		counts.elided[call]++;
+		return;
+	}
+	if (on)
+		glEnableClientState(array);
+	else glDisableClientState(array);
+	counts.issued[call]++;
+	if (i >= 0)
+		arrays[i] = on ? 1 : 0;
+}
+
+void GLState::enableClientState(unsigned int array) {
+	setArray(array, true);
+}
+
+void GLState::disableClientState(unsigned int array) {
+	setArray(array, false);
+}
+
+void GLState::bindTexture(unsigned int id) {
+	if (texture == (long)id) {
+		counts.elided[GLS_BIND_TEXTURE]++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, id);
+	counts.issued[GLS_BIND_TEXTURE]++;
+	texture = (long)id;
+}
+
+void GLState::material(unsigned int pname, const float* params) {
+	int i = materialIndex(pname);
+	int size = pname == GL_SHININESS ? 1 : 4;
+	if (i >= 0 && materialKnown[i] && memcmp(materials[i], params, size * sizeof(float)) == 0) {
+		counts.elided[GLS_MATERIALFV]++;
+		return;
+	}
+	glMaterialfv(GL_FRONT, pname, params);
+	counts.issued[GLS_MATERIALFV]++;
+	if (i >= 0) {
+		memcpy(materials[i], params, size * sizeof(float));
+		materialKnown[i] = true;
+	}
+}
+
+void GLState::color(float r, float g, float b) {
+	if (colorKnown && colors[0] == r && colors[1] == g && colors[2] == b) {
+		counts.elided[GLS_COLOR3F]++;
+		return;
+	}
+	glColor3f(r, g, b);
+	counts.issued[GLS_COLOR3F]++;
+	colors[0] = r;
+	colors[1] = g;
+	colors[2] = b;
+	colorKnown = true;
+	if (caps[capIndex(GL_COLOR_MATERIAL)] != 0)
+		materialKnown[0] = materialKnown[1] = false; //Ambient and diffuse follow it
+}
+
+void GLState::matrixMode(unsigned int m) {
+	if (mode == (long)m) {
+		counts.elided[GLS_MATRIX_MODE]++;
+		return;
+	}
+	glMatrixMode(m);
+	counts.issued[GLS_MATRIX_MODE]++;
+	mode = (long)m;
+}
+
+void GLState::callList(unsigned int list) {
+	glCallList(list);
+	for (int i = 0; i < MATERIALS; i++)
+		materialKnown[i] = false;
+	colorKnown = false;
+}
+
+void GLState::endFrame() {
+	for (int i = 0; i < GLS_CALLS; i++) {
+		lastFrame.issued[i] = counts.issued[i] - frameStart.issued[i];
+		lastFrame.elided[i] = counts.elided[i] - frameStart.elided[i];
+	}
+	frameStart = counts;
+}
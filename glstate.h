@@ -0,0 +1,87 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+//A shadow of the GL state the renderer changes over and over: capabilities,
+//client arrays, the bound texture, the front material, the current colour
+//and the matrix mode.  Rendering sets them through glState, which skips a
+//call that would set what is already set and counts the calls it issued
+//and skipped.
+//
+//The shadow only knows what went through it.  Whoever changes the same
+//state behind its back (display lists, glPopAttrib) calls invalidate()
+//afterwards, or callList() instead of glCallList().  With GL_COLOR_MATERIAL
+//on, a new colour is also a new ambient and diffuse, so they are forgotten
+//whenever the colour changes.
+//
+//Takes plain C types so it can be included without the GL headers.
+
+//The calls that go through the shadow
+enum GLStateCall {
+	GLS_ENABLE, GLS_DISABLE, GLS_ENABLE_CLIENT_STATE, GLS_DISABLE_CLIENT_STATE,
+	GLS_BIND_TEXTURE, GLS_MATERIALFV, GLS_COLOR3F, GLS_MATRIX_MODE,
+	GLS_CALLS
+};
+
+struct GLStateCounts {
+	GLStateCounts();
+
+	long issued[GLS_CALLS];
+	long elided[GLS_CALLS];
+
+	long totalIssued() const;
+	long totalElided() const;
+};
+
+class GLState {
+public:
+	static const int CAPS = 8;       //Capabilities shadowed; others always go through
+	static const int MATERIALS = 5;  //Ambient, diffuse, specular, emission, shininess
+
+	GLState();
+
+	//glEnable/glDisable of cap (GLenum)
+	void enable(unsigned int cap);
+	void disable(unsigned int cap);
+	void enableClientState(unsigned int array);
+	void disableClientState(unsigned int array);
+	//glBindTexture(GL_TEXTURE_2D, texture)
+	void bindTexture(unsigned int texture);
+	//glMaterialfv(GL_FRONT, pname, params)
+	void material(unsigned int pname, const float* params);
+	void color(float r, float g, float b);
+	void matrixMode(unsigned int mode);
+
+	//glCallList(list), then forgets the material and colour: the lists
+	//render.cpp builds set those and nothing else shadowed
+	void callList(unsigned int list);
+
+	//Forgets everything, so every call goes through until it is known again
+	void invalidate();
+
+	//Ends a frame: lastFrame becomes the calls since the previous one
+	void endFrame();
+
+	GLStateCounts counts;    //Since the program started
+	GLStateCounts lastFrame; //Of the frame endFrame() last ended
+private:
+	enum {
+		UNKNOWN = -1
+	};
+
+	signed char caps[CAPS];   //On, off or UNKNOWN, by capIndex()
+	signed char arrays[2];    //Vertex and normal arrays
+	long texture;             //Bound to GL_TEXTURE_2D, or UNKNOWN
+	bool materialKnown[MATERIALS];
+	float materials[MATERIALS][4];
+	bool colorKnown;
+	float colors[3];
+	long mode;                //Matrix mode, or UNKNOWN
+	GLStateCounts frameStart; //counts when the frame began
+
+	void setCap(unsigned int cap, bool on);
+	void setArray(unsigned int array, bool on);
+};
+
+extern GLState glState;
+
+#endif
@@ -0,0 +1,379 @@
+#include "imageloader.h"
+#include "mappedfile.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define SWIZZLE_SSSE3
+#endif
+
+Image::Image(char* ps, int w, int h) : pixels(ps), width(w), height(h), ownsPixels(true) {
+
+}
+
+Image::Image(char* ps, int w, int h, bool owned) : pixels(ps), width(w), height(h), ownsPixels(owned) {
+
+}
+
+Image::~Image() {
+	if (ownsPixels)
+		delete[] pixels;
+}
+
+namespace {
+	//Converts a four-character array to an integer, using little-endian form
+	int toInt(const char* bytes) {
+		return (int)(((unsigned char)bytes[3] << 24) |
+			((unsigned char)bytes[2] << 16) |
+			((unsigned char)bytes[1] << 8) |
+			(unsigned char)bytes[0]);
+	}
+
+	//Converts a two-character array to a short, using little-endian form
+	short toShort(const char* bytes) {
+		return (short)(((unsigned char)bytes[1] << 8) |
+			(unsigned char)bytes[0]);
+	}
+
+	//Copies one row of BGR pixels to RGB
+	void swizzleRow(const char* src, char* dst, int width) {
+		int x = 0;
+#ifdef SWIZZLE_SSSE3
+		//Five pixels per 16 byte load; the 16th byte is the next pixel's blue,
+		//which the next store overwrites.  Stop while a whole register still
+		//fits in the row.
+		const __m128i order = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		for (; x + 6 <= width; x += 5) {
+			__m128i bgr = _mm_loadu_si128((const __m128i*)(src + 3 * x));
+			_mm_storeu_si128((__m128i*)(dst + 3 * x), _mm_shuffle_epi8(bgr, order));
+		}
+#endif
+		for (; x < width; x++) {
+			dst[3 * x] = src[3 * x + 2];
+			dst[3 * x + 1] = src[3 * x + 1];
+			dst[3 * x + 2] = src[3 * x];
+		}
+	}
+}
+
+Image* loadBMP(const char* filename) {
+	MappedFile input(filename);
+	assert(input.data != NULL || !"Could not find file");
+	const char* bytes = input.data;
+	assert((bytes[0] == 'B' && bytes[1] == 'M') || !"Not a bitmap file");
+	int dataOffset = toInt(bytes + 10);
+
+	//Read the header
+	int headerSize = toInt(bytes + 14);
+	int width;
+	int height;
+	switch (headerSize) {
+	case 40:
+		//V3
+		width = toInt(bytes + 18);
+		height = toInt(bytes + 22);
+		assert(toShort(bytes + 28) == 24 || !"Image is not 24 bits per pixel");
+		assert(toShort(bytes + 30) == 0 || !"Image is compressed");
+		break;
+	case 12:
+		//OS/2 V1
+		width = toShort(bytes + 18);
+		height = toShort(bytes + 20);
+		assert(toShort(bytes + 24) == 24 || !"Image is not 24 bits per pixel");
+		break;
+	case 64:
+		//OS/2 V2
+		assert(!"Can't load OS/2 V2 bitmaps");
+		break;
+	case 108:
+		//Windows V4
+		assert(!"Can't load Windows V4 bitmaps");
+		break;
+	case 124:
+		//Windows V5
+		assert(!"Can't load Windows V5 bitmaps");
+		break;
+	default:
+		assert(!"Unknown bitmap format");
+	}
+
+	//Rows are padded to a multiple of four bytes in the file
+	int bytesPerRow = ((width * 3 + 3) / 4) * 4;
+	assert((size_t)dataOffset + (size_t)bytesPerRow * height <= input.size || !"Bitmap is truncated");
+
+	//Get the data into the right format
+	char* pixels = new char[width * height * 3];
+	for (int y = 0; y < height; y++)
+		swizzleRow(bytes + dataOffset + bytesPerRow * y, pixels + 3 * width * y, width);
+	return new Image(pixels, width, height);
+}
+
+Image* resizeImage(const Image* image, int width, int height) {
+	char* pixels = new char[width * height * 3];
+	for (int y = 0; y < height; y++) {
+		int y0 = y * image->height / height;
+		int y1 = (y + 1) * image->height / height;
+		if (y1 <= y0)
+			y1 = y0 + 1;
+		for (int x = 0; x < width; x++) {
+			int x0 = x * image->width / width;
+			int x1 = (x + 1) * image->width / width;
+			if (x1 <= x0)
+				x1 = x0 + 1;
+			int sum[3] = { 0, 0, 0 };
+			for (int sy = y0; sy < y1; sy++) {
+				const unsigned char* row = (const unsigned char*)image->pixels + 3 * image->width * sy;
+				for (int sx = x0; sx < x1; sx++) {
+					for (int c = 0; c < 3; c++)
+						sum[c] += row[3 * sx + c];
+				}
+			}
+			int n = (y1 - y0) * (x1 - x0);
+			for (int c = 0; c < 3; c++)
+				pixels[3 * (width * y + x) + c] = (char)((sum[c] + n / 2) / n);
+		}
+	}
+	return new Image(pixels, width, height);
+}
+
+namespace {
+	//Layout of a texture cache file: a header, one entry per texture, then
+	//the pixels of every mipmap level of every texture, each level starting
+	//on a 16 byte boundary.  Written in the machine's own byte order, as it
+	//is only ever read back on the same machine.
+	const char CACHE_MAGIC[4] = { 'D', 'X', 'T', 'C' };
+	const int CACHE_VERSION = 2;
+
+	struct CacheHeader {
+		char magic[4];
+		int version;
+		int count;
+		int reserved;
+	};
+
+	struct CacheEntry {
+		char name[64];     //The bitmap the texture came from
+		long long size;    //Size and modification time of the bitmap
+		long long time;
+		long long offset;  //Where level 0 starts in the cache file
+		int specWidth;     //The TextureSpec it was built for
+		int specHeight;
+		int width;         //Size of level 0
+		int height;
+		int levels;
+		int reserved;
+	};
+
+	//Size of a mipmap level, as OpenGL expects it
+	int levelSize(int size, int level) {
+		size >>= level;
+		return size > 0 ? size : 1;
+	}
+
+	int levelCount(int width, int height) {
+		int levels = 1;
+		while (width > 1 || height > 1) {
+			width = levelSize(width, 1);
+			height = levelSize(height, 1);
+			levels++;
+		}
+		return levels;
+	}
+
+	long long align16(long long offset) {
+		return (offset + 15) / 16 * 16;
+	}
+
+	//Size and modification time of a file, or false if it can't be found
+	bool fileInfo(const char* filename, long long &size, long long &time) {
+		struct stat info;
+		if (stat(filename, &info) != 0)
+			return false;
+		size = (long long)info.st_size;
+		time = (long long)info.st_mtime;
+		return true;
+	}
+
+	bool cacheValid(const MappedFile &map, const TextureSpec* specs, int count) {
+		if (map.data == NULL || map.size < sizeof(CacheHeader) + count * sizeof(CacheEntry))
+			return false;
+		const CacheHeader* header = (const CacheHeader*)map.data;
+		if (memcmp(header->magic, CACHE_MAGIC, 4) != 0 || header->version != CACHE_VERSION ||
+			header->count != count)
+			return false;
+		const CacheEntry* entries = (const CacheEntry*)(header + 1);
+		for (int i = 0; i < count; i++) {
+			const CacheEntry &e = entries[i];
+			if (strncmp(e.name, specs[i].bmp, sizeof(e.name)) != 0 ||
+				e.specWidth != specs[i].width || e.specHeight != specs[i].height)
+				return false;
+			if (e.width <= 0 || e.height <= 0 || e.levels != levelCount(e.width, e.height))
+				return false;
+			long long end = e.offset;
+			for (int k = 0; k < e.levels; k++)
+				end = align16(end) + 3LL * levelSize(e.width, k) * levelSize(e.height, k);
+			if (e.offset < 0 || (size_t)end > map.size)
+				return false;
+			long long size, time;
+			if (fileInfo(specs[i].bmp, size, time) && (size != e.size || time != e.time))
+				return false;
+		}
+		return true;
+	}
+
+	//Decodes a bitmap, resizes it to its spec and adds its mipmap chain
+	void buildTexture(const TextureSpec &spec, std::vector<Image*> &images) {
+		Image* image = loadBMP(spec.bmp);
+		if (spec.width > 0 && spec.height > 0 &&
+			(spec.width != image->width || spec.height != image->height)) {
+			Image* resized = resizeImage(image, spec.width, spec.height);
+			delete image;
+			image = resized;
+		}
+		images.push_back(image);
+		int levels = levelCount(image->width, image->height);
+		for (int k = 1; k < levels; k++) {
+			image = resizeImage(image, levelSize(image->width, 1), levelSize(image->height, 1));
+			images.push_back(image);
+		}
+	}
+
+	bool writeCache(const char* cacheFile, const TextureSpec* specs, int count,
+		const std::vector<std::vector<Image*> > &textures) {
+		CacheHeader header;
+		memcpy(header.magic, CACHE_MAGIC, 4);
+		header.version = CACHE_VERSION;
+		header.count = count;
+		header.reserved = 0;
+
+		std::vector<CacheEntry> entries(count);
+		long long offset = sizeof(CacheHeader) + count * sizeof(CacheEntry);
+		for (int i = 0; i < count; i++) {
+			CacheEntry &e = entries[i];
+			memset(&e, 0, sizeof(e));
+			strncpy(e.name, specs[i].bmp, sizeof(e.name) - 1);
+			fileInfo(specs[i].bmp, e.size, e.time);
+			e.specWidth = specs[i].width;
+			e.specHeight = specs[i].height;
+			const std::vector<Image*> &images = textures[i];
+			e.width = images[0]->width;
+			e.height = images[0]->height;
+			e.levels = (int)images.size();
+			e.offset = align16(offset);
+			for (size_t j = 0; j < images.size(); j++)
+				offset = align16(offset) + 3LL * images[j]->width * images[j]->height;
+		}
+
+		FILE* output = fopen(cacheFile, "wb");
+		if (output == NULL)
+			return false;
+		bool ok = fwrite(&header, sizeof(header), 1, output) == 1 &&
+			fwrite(&entries[0], sizeof(CacheEntry), count, output) == (size_t)count;
+		long long written = sizeof(CacheHeader) + count * sizeof(CacheEntry);
+		static const char zeros[16] = { 0 };
+		for (int i = 0; i < count && ok; i++) {
+			const std::vector<Image*> &images = textures[i];
+			for (size_t j = 0; j < images.size() && ok; j++) {
+				size_t padding = (size_t)(align16(written) - written);
+				size_t bytes = (size_t)images[j]->width * images[j]->height * 3;
+				ok = fwrite(zeros, 1, padding, output) == padding &&
+					fwrite(images[j]->pixels, 1, bytes, output) == bytes;
+				written += padding + bytes;
+			}
+		}
+		ok = fclose(output) == 0 && ok;
+		if (!ok)
+			remove(cacheFile);
+		return ok;
+	}
+}
+
+TextureCache::TextureCache(const char* cacheFile, const TextureSpec* specs, int count, const int* order) :
+	map(NULL), file(cacheFile), specs(specs, specs + count), textures(count), built(count, false), next(0), left(0),
+	written(count == 0) {
+	map = new MappedFile(cacheFile);
+	if (cacheValid(*map, specs, count)) {
+		const CacheEntry* entries = (const CacheEntry*)(map->data + sizeof(CacheHeader));
+		for (int i = 0; i < count; i++) {
+			long long offset = entries[i].offset;
+			for (int k = 0; k < entries[i].levels; k++) {
+				int width = levelSize(entries[i].width, k);
+				int height = levelSize(entries[i].height, k);
+				offset = align16(offset);
+				textures[i].push_back(new Image((char*)map->data + offset, width, height, false));
+				offset += 3LL * width * height;
+			}
+			built[i] = true;
+		}
+		written = true;
+		return;
+	}
+	delete map;
+	map = NULL;
+
+	for (int i = 0; i < count; i++)
+		this->order.push_back(order != NULL ? order[i] : i);
+	left = count;
+	int threads = (int)std::thread::hardware_concurrency();
+	if (threads > count)
+		threads = count;
+	if (threads < 1)
+		threads = 1;
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&TextureCache::work, this));
+}
+
+TextureCache::~TextureCache() {
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for (size_t i = 0; i < textures.size(); i++) {
+		for (size_t j = 0; j < textures[i].size(); j++)
+			delete textures[i][j];
+	}
+	delete map;
+}
+
+bool TextureCache::ready(int i) {
+	std::lock_guard<std::mutex> guard(lock);
+	return built[i];
+}
+
+void TextureCache::wait(int i) {
+	std::unique_lock<std::mutex> guard(lock);
+	while (!built[i])
+		done.wait(guard);
+}
+
+bool TextureCache::finished() {
+	std::lock_guard<std::mutex> guard(lock);
+	return written;
+}
+
+//Builds textures in order until none are left; whoever builds the last
+//writes the cache
+void TextureCache::work() {
+	for (;;) {
+		int k = next++;
+		if (k >= (int)order.size())
+			return;
+		int i = order[k];
+		std::vector<Image*> images;
+		buildTexture(specs[i], images);
+		bool last;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			textures[i] = images;
+			built[i] = true;
+			last = --left == 0;
+		}
+		done.notify_all();
+		if (last) {
+			writeCache(file.c_str(), &specs[0], (int)specs.size(), textures);
+			std::lock_guard<std::mutex> guard(lock);
+			written = true;
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+//Bitmap loading for the textures.  Bitmaps are read through a memory mapping
+//and swizzled from BGR to RGB with SSSE3 when the compiler allows it
+//(-mssse3 or -mavx2), a plain loop otherwise.
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MappedFile; //mappedfile.h
+
+//Represents an image
+class Image {
+public:
+	Image(char* ps, int w, int h);
+	//An image whose pixels live in memory someone else owns, e.g. a mapped file
+	Image(char* ps, int w, int h, bool owned);
+	~Image();
+
+	/* An array of the form (R1, G1, B1, R2, G2, B2, ...) indicating the
+	* color of each pixel in image.  Color components range from 0 to 255.
+	* The array starts the bottom-left pixel, then moves right to the end
+	* of the row, then moves up to the next column, and so on.  This is the
+	* format in which OpenGL likes images.  Rows are tightly packed, so
+	* GL_UNPACK_ALIGNMENT must be 1 when uploading.
+	*/
+	char* pixels;
+	int width;
+	int height;
+private:
+	bool ownsPixels;
+};
+
+//Reads a bitmap image from file.
+Image* loadBMP(const char* filename);
+
+//A new image of the given size, each pixel the average of the block of
+//image it covers
+Image* resizeImage(const Image* image, int width, int height);
+
+//What a texture should look like once it is built
+struct TextureSpec {
+	const char* bmp;
+	//Size of the full-size level, usually the texture's on-screen footprint.
+	//0 keeps the bitmap's own size.
+	int width;
+	int height;
+};
+
+//Textures built from bitmaps (resized and with a full mipmap chain) and baked
+//into one file, so later runs can map it and hand the pixels straight to
+//OpenGL instead of decoding the bitmaps again.  Needs C++11 threads.
+class TextureCache {
+public:
+	//Maps cacheFile.  If it is missing, older than any of the bitmaps or was
+	//built for different specs, the textures are built on a thread per core,
+	//in order (the indices of all count textures, or NULL for 0 to count-1),
+	//and the cache is written once the last is done.  If it cannot be
+	//written, the built images are kept in memory instead.  specs are
+	//copied, but the names they point to must outlive the cache.
+	TextureCache(const char* cacheFile, const TextureSpec* specs, int count, const int* order = NULL);
+	//Waits for the textures still being built
+	~TextureCache();
+
+	//Whether texture i has been built, i.e. can be used without waiting
+	bool ready(int i);
+	//Waits until it has
+	void wait(int i);
+	//Whether every texture has been built and the cache written, i.e. the
+	//cache can be deleted without waiting
+	bool finished();
+
+	//Number of mipmap levels of texture i, down to 1x1.  Only once it is
+	//ready.
+	int levels(int i) const {
+		return (int)textures[i].size();
+	}
+
+	//Mipmap level of texture i; level 0 is the full size, each level after
+	//it half the size of the one before.  Only once it is ready.
+	Image* image(int i, int level = 0) {
+		return textures[i][level];
+	}
+private:
+	MappedFile* map;
+	std::string file;
+	std::vector<TextureSpec> specs;
+	std::vector<std::vector<Image*> > textures; //Mipmap levels of each texture
+	std::vector<bool> built;
+	std::vector<int> order;
+	std::atomic<int> next; //Of order, the next to build
+	int left;              //Still to build
+	bool written;          //The cache has been written, or did not need to be
+	std::mutex lock;       //Over textures, built, left and written while building
+	std::condition_variable done;
+	std::vector<std::thread> workers;
+
+	void work();
+
+	TextureCache(const TextureCache &);
+	void operator=(const TextureCache &);
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "inputlog.h"
+#include <string.h>
+
+namespace {
+	const char LOG_MAGIC[4] = { 'D', 'X', 'I', 'N' };
+	const unsigned char LOG_VERSION = 2;
+	const unsigned char END_RECORD = 0xff;
+
+	void writeWord(FILE* file, unsigned int word) {
+		unsigned char bytes[4];
+		for (int i = 0; i < 4; i++)
+			bytes[i] = (unsigned char)(word >> (8 * i));
+		fwrite(bytes, 1, 4, file);
+	}
+
+	bool readWord(const unsigned char* &p, const unsigned char* end, unsigned int &word) {
+		if (end - p < 4)
+			return false;
+		word = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+		p += 4;
+		return true;
+	}
+
+	bool readTicks(const unsigned char* &p, const unsigned char* end, long &ticks) {
+		ticks = 0;
+		for (int shift = 0; p < end && shift < 63; shift += 7) {
+			unsigned char byte = *p++;
+			ticks |= (long)(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+InputRecorder::InputRecorder() : file(NULL), lastTick(0) {
+
+}
+
+InputRecorder::~InputRecorder() {
+	if (file != NULL)
+		fclose(file);
+}
+
+bool InputRecorder::open(const char* filename, unsigned int seed, const GameParams* params) {
+	if (file != NULL)
+		fclose(file);
+	file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	fwrite(LOG_MAGIC, 1, 4, file);
+	fputc(LOG_VERSION, file);
+	writeWord(file, seed);
+	writeWord(file, paramsHash(params != NULL ? *params : GameParams()));
+	lastTick = 0;
+	return true;
+}
+
+void InputRecorder::writeTicks(long ticks) {
+	do {
+		unsigned char byte = ticks & 0x7f;
+		ticks >>= 7;
+		fputc(ticks != 0 ? byte | 0x80 : byte, file);
+	} while (ticks != 0);
+}
+
+void InputRecorder::record(long tick, InputType input) {
+	if (file == NULL)
+		return;
+	writeTicks(tick - lastTick);
+	fputc((unsigned char)input, file);
+	lastTick = tick;
+}
+
+void InputRecorder::close(const GameState &state) {
+	if (file == NULL)
+		return;
+	writeTicks(state.tick - lastTick);
+	fputc(END_RECORD, file);
+	writeWord(file, stateHash(state));
+	fclose(file);
+	file = NULL;
+}
+
+InputLog::InputLog() : seed(1), rules(0), complete(false), endTick(0), endHash(0) {
+
+}
+
+bool InputLog::load(const char* filename) {
+	inputs.clear();
+	complete = false;
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return false;
+	std::vector<unsigned char> bytes;
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	fclose(file);
+
+	if (bytes.size() < 13 || memcmp(&bytes[0], LOG_MAGIC, 4) != 0 || bytes[4] != LOG_VERSION)
+		return false;
+	const unsigned char* p = &bytes[0] + 5;
+	const unsigned char* end = &bytes[0] + bytes.size();
+	readWord(p, end, seed);
+	readWord(p, end, rules);
+
+	//A log cut short (e.g. the game crashed) is kept up to its last whole record
+	long tick = 0;
+	while (p < end) {
+		long ticks;
+		if (!readTicks(p, end, ticks) || p >= end)
+			break;
+		tick += ticks;
+		unsigned char type = *p++;
+		if (type == END_RECORD) {
+			complete = readWord(p, end, endHash);
+			endTick = tick;
+			break;
+		}
+		if (type > INPUT_STAGE)
+			break;
+		LoggedInput input = { tick, (InputType)type };
+		inputs.push_back(input);
+	}
+	return true;
+}
+
+bool InputLog::playedBy(const GameParams* params) const {
+	return rules == paramsHash(params != NULL ? *params : GameParams());
+}
+
+long replay(const InputLog &log, GameState &state, const GameParams* params) {
+	if (!log.playedBy(params))
+		return -1;
+	state = GameState(log.seed, params);
+	long end = log.complete ? log.endTick : (log.inputs.empty() ? 0 : log.inputs.back().tick);
+	long points = 0;
+	size_t next = 0;
+	for (;;) {
+		//One by one rather than through Inputs, which holds at most
+		//MAX_TICK_INPUTS; a fast mouse moves more often than that in a tick
+		while (next < log.inputs.size() && log.inputs[next].tick == state.tick)
+			applyInput(state, log.inputs[next++].input);
+		if (state.tick >= end)
+			break;
+		//Nothing can change the match between inputs but the match itself,
+		//so jump from event to event up to the next input
+		long until = next < log.inputs.size() && log.inputs[next].tick < end ? log.inputs[next].tick : end;
+		if (stepToEvent(state, until - state.tick))
+			points++;
+	}
+	return points;
+}
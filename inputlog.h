@@ -0,0 +1,72 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+//Recording of the player inputs of a match, so it can be replayed exactly
+//without a window.
+//
+//A log is the match seed and paramsHash() of the rules it was played by,
+//followed by one record per input: the number of
+//ticks since the previous input as a variable-length integer (7 bits per
+//byte, low bits first), then the InputType byte.  Most records are two
+//bytes.  A closed log ends with an END record holding the tick the match
+//stopped at and stateHash() of the match at that point.
+#include "game.h"
+#include <stdio.h>
+#include <vector>
+
+//Writes a log as the inputs happen
+class InputRecorder {
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	//Starts a log for a match made with GameState(seed, params)
+	bool open(const char* filename, unsigned int seed, const GameParams* params = 0);
+
+	//An input applied to the match when it had run tick ticks, i.e. just
+	//before step() runs for the tick+1th time
+	void record(long tick, InputType input);
+
+	//Ends the log with the state the match is left in
+	void close(const GameState &state);
+private:
+	FILE* file;
+	long lastTick;
+
+	void writeTicks(long ticks);
+
+	InputRecorder(const InputRecorder &);
+	void operator=(const InputRecorder &);
+};
+
+struct LoggedInput {
+	long tick;
+	InputType input;
+};
+
+//A log read back in full
+struct InputLog {
+	InputLog();
+
+	//Reads filename; false if it is missing or not an input log
+	bool load(const char* filename);
+
+	//Whether the match was played by params (the defaults if null)
+	bool playedBy(const GameParams* params) const;
+
+	unsigned int seed;
+	unsigned int rules;     //paramsHash() of the match's params
+	std::vector<LoggedInput> inputs;
+	bool complete;          //Whether the log was closed; if not the rest is unknown
+	long endTick;           //Only if complete
+	unsigned int endHash;
+};
+
+//Plays the logged match from GameState(log.seed, params) up to its end tick
+//(or its last input if it was never closed), applying each input just where
+//it was applied live.  Returns the number of points scored, or -1 without
+//playing if the match was not played by params: it would play out
+//differently.
+long replay(const InputLog &log, GameState &state, const GameParams* params = 0);
+
+#endif
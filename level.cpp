@@ -0,0 +1,179 @@
+#include "level.h"
+#include "mappedfile.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+	//The game's own stages.  The fans and the barrier come first, in the
+	//order step() has always tried them.
+	const LevelObstacle STAGE1[] = {
+		//x, reach, inner, lo, hi, position, size, tilt, spinOffset, color, spin, spinAxis, spinSign, texture, kind, flags
+		{ 6.8, 1.4, .5, 0, 0, { 6.8f, 0, 0 }, { 2, .3f, 1 }, -10, 0, { 1, 0, 0 }, SPIN_FAN, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_FAN, 0 }, //Right fan
+		{ 0, 0, 0, 0, 0, { 6.8f, 0, 0 }, { 2, .3f, 1 }, -10, 90, { 1, 0, 0 }, SPIN_FAN, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_SCENERY, 0 },
+		{ -6.8, 1.4, .5, 0, 0, { -6.8f, 0, 0 }, { 2, .3f, 1 }, -10, 0, { 1, 0, 0 }, SPIN_FAN, 2, -1, LEVEL_NO_TEXTURE, OBSTACLE_FAN, 0 }, //Left fan
+		{ 0, 0, 0, 0, 0, { -6.8f, 0, 0 }, { 2, .3f, 1 }, -10, 90, { 1, 0, 0 }, SPIN_FAN, 2, -1, LEVEL_NO_TEXTURE, OBSTACLE_SCENERY, 0 },
+		{ 0, 14, 25, 0, 0, { 0, 0, -1 }, { 11, .3f, 1 }, 0, 0, { .5f, .5f, .5f }, SPIN_BARRIER, 0, 1, 3, OBSTACLE_BARRIER, 0 }, //Middle barrier
+		{ 0, 0, 0, 0, 0, { -9, 0, -1 }, { 2, .3f, 1 }, 0, 0, { .5f, .5f, .5f }, SPIN_BARRIER, 0, -1, 3, OBSTACLE_SCENERY, 0 },
+		{ 0, 0, 0, 0, 0, { 9, 0, -1 }, { 2, .3f, 1 }, 0, 0, { .5f, .5f, .5f }, SPIN_BARRIER, 0, -1, 3, OBSTACLE_SCENERY, 0 },
+		{ 9.4, 0, 0, -1000, 1000, { 9.95f, 0, 0 }, { .2f, 20, .2f }, 0, 0, { 1, 0, 0 }, SPIN_NONE, 2, 1, 4, OBSTACLE_WALL, 0 }, //Barricades
+		{ -9.4, 0, 0, -1000, 1000, { -9.95f, 0, 0 }, { .2f, 20, .2f }, 0, 0, { 1, 0, 0 }, SPIN_NONE, 2, 1, 4, OBSTACLE_WALL, 0 },
+	};
+
+	const LevelObstacle STAGE2[] = {
+		{ 0, 2.5, 1, 0, 0, { 0, 0, 0 }, { 4, .5f, 1 }, -10, 0, { 0, 0, 1 }, SPIN_FAN, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_FAN, FAN_SIDEWAYS }, //Middle fan
+		{ 0, 0, 0, 0, 0, { 0, 0, 0 }, { 4, .5f, 1 }, -10, 90, { 0, 0, 1 }, SPIN_FAN, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_SCENERY, 0 },
+		{ -9.8, 0, .1, -4.5, 4.5, { 0, 0, 0 }, { 0, 0, 0 }, 0, 0, { 0, 0, 0 }, SPIN_NONE, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_WRAP, 0 }, //Gaps in the side walls
+		{ 9.8, 0, .1, -4.5, 4.5, { 0, 0, 0 }, { 0, 0, 0 }, 0, 0, { 0, 0, 0 }, SPIN_NONE, 2, 1, LEVEL_NO_TEXTURE, OBSTACLE_WRAP, 0 },
+		{ 9.8, 0, 0, -1000, -4.5, { 9.95f, -8, 0 }, { .2f, 7, .2f }, 0, 0, { 0, 0, 1 }, SPIN_NONE, 2, 1, 8, OBSTACLE_WALL, 0 }, //Barricades
+		{ -9.8, 0, 0, -1000, -4.5, { -9.95f, -8, 0 }, { .2f, 7, .2f }, 0, 0, { 0, 0, 1 }, SPIN_NONE, 2, 1, 8, OBSTACLE_WALL, 0 },
+		{ 9.8, 0, 0, 4.5, 1000, { 9.95f, 8, 0 }, { .2f, 7, .2f }, 0, 0, { 0, 0, 1 }, SPIN_NONE, 2, 1, 8, OBSTACLE_WALL, 0 },
+		{ -9.8, 0, 0, 4.5, 1000, { -9.95f, 8, 0 }, { .2f, 7, .2f }, 0, 0, { 0, 0, 1 }, SPIN_NONE, 2, 1, 8, OBSTACLE_WALL, 0 },
+	};
+
+	const int STAGE1_COUNT = sizeof(STAGE1) / sizeof(STAGE1[0]);
+	const int STAGE2_COUNT = sizeof(STAGE2) / sizeof(STAGE2[0]);
+
+	//serveY, firstObstacle, obstacles, background, paddle, ball
+	const LevelStage STAGES[] = {
+		{ 0, 0, STAGE1_COUNT, 0, 1, 2, 0 },
+		{ .1, STAGE1_COUNT, STAGE2_COUNT, 5, 6, 7, 0 },
+	};
+
+	//Texture coordinates come from glTexGen in world units, so every texture
+	//but the backgrounds covers one unit (about 45 pixels) on screen and is
+	//repeated; 64x64 is plenty
+	const LevelTexture TEXTURES[] = {
+		{ "stage1.bmp", 0, 0 }, { "plank1.bmp", 64, 64 }, { "ball.bmp", 64, 64 }, { "barrier.bmp", 64, 64 },
+		{ "plank3.bmp", 64, 64 },
+		{ "stage2.bmp", 0, 0 }, { "plank2.bmp", 64, 64 }, { "ball2.bmp", 64, 64 }, { "barrier2.bmp", 64, 64 },
+	};
+
+	//Whether count entries of size bytes at offset lie inside a level of
+	//total bytes, suitably aligned
+	bool fits(long long offset, long long count, size_t size, long long total) {
+		return offset >= (long long)sizeof(LevelHeader) && offset % 8 == 0 && count >= 0 &&
+			offset + count * (long long)size <= total;
+	}
+
+	bool validTexture(int texture, int count) {
+		return texture == LEVEL_NO_TEXTURE || (texture >= 0 && texture < count);
+	}
+}
+
+Level::Level() : map(NULL) {
+	LevelHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DXLV", 4);
+	header.version = LEVEL_VERSION;
+	header.stageCount = sizeof(STAGES) / sizeof(STAGES[0]);
+	header.obstacleCount = STAGE1_COUNT + STAGE2_COUNT;
+	header.textureCount = sizeof(TEXTURES) / sizeof(TEXTURES[0]);
+	header.stages = sizeof(LevelHeader);
+	header.obstacles = header.stages + header.stageCount * sizeof(LevelStage);
+	header.textures = header.obstacles + header.obstacleCount * sizeof(LevelObstacle);
+	header.size = header.textures + header.textureCount * sizeof(LevelTexture);
+	header.fanTurn = 20;
+	header.barrierTurn = 5;
+	header.barrierServe = 31;
+
+	std::vector<char> bytes(header.size);
+	memcpy(&bytes[0], &header, sizeof(header));
+	memcpy(&bytes[header.stages], STAGES, sizeof(STAGES));
+	memcpy(&bytes[header.obstacles], STAGE1, sizeof(STAGE1));
+	memcpy(&bytes[header.obstacles + sizeof(STAGE1)], STAGE2, sizeof(STAGE2));
+	memcpy(&bytes[header.textures], TEXTURES, sizeof(TEXTURES));
+	copy(&bytes[0], bytes.size());
+}
+
+Level::Level(const Level &other) : map(NULL) {
+	copy((const char*)other.head, other.head->size);
+}
+
+Level::~Level() {
+	delete map;
+}
+
+const Level &Level::builtIn() {
+	static const Level level;
+	return level;
+}
+
+bool Level::point(const char* data, size_t size) {
+	if (size < sizeof(LevelHeader))
+		return false;
+	const LevelHeader* h = (const LevelHeader*)data;
+	if (memcmp(h->magic, "DXLV", 4) != 0 || h->version != LEVEL_VERSION || h->size < 0 ||
+		(size_t)h->size != size || h->stageCount < 1 ||
+		!fits(h->stages, h->stageCount, sizeof(LevelStage), size) ||
+		!fits(h->obstacles, h->obstacleCount, sizeof(LevelObstacle), size) ||
+		!fits(h->textures, h->textureCount, sizeof(LevelTexture), size))
+		return false;
+
+	const LevelStage* stages = (const LevelStage*)(data + h->stages);
+	const LevelObstacle* obstacles = (const LevelObstacle*)(data + h->obstacles);
+	const LevelTexture* textures = (const LevelTexture*)(data + h->textures);
+	for (int i = 0; i < h->stageCount; i++) {
+		const LevelStage &s = stages[i];
+		if (s.firstObstacle < 0 || s.obstacles < 0 || s.firstObstacle > h->obstacleCount - s.obstacles ||
+			!validTexture(s.background, h->textureCount) || !validTexture(s.paddle, h->textureCount) ||
+			!validTexture(s.ball, h->textureCount))
+			return false;
+	}
+	for (int i = 0; i < h->obstacleCount; i++) {
+		const LevelObstacle &o = obstacles[i];
+		if (o.kind < OBSTACLE_SCENERY || o.kind > OBSTACLE_WRAP || o.spin < SPIN_NONE || o.spin > SPIN_BARRIER ||
+			o.spinAxis < 0 || o.spinAxis > 2 || !validTexture(o.texture, h->textureCount))
+			return false;
+	}
+	for (int i = 0; i < h->textureCount; i++) {
+		if (memchr(textures[i].bmp, 0, sizeof(textures[i].bmp)) == NULL)
+			return false;
+	}
+
+	head = h;
+	stageTable = stages;
+	obstacleTable = obstacles;
+	textureTable = textures;
+	return true;
+}
+
+void Level::copy(const char* data, size_t size) {
+	std::vector<double> bytes((size + sizeof(double) - 1) / sizeof(double));
+	memcpy(&bytes[0], data, size);
+	memory.swap(bytes);
+	point((const char*)&memory[0], size);
+	delete map;
+	map = NULL;
+}
+
+bool Level::load(const char* filename) {
+	MappedFile* file = new MappedFile(filename);
+	if (file->data == NULL || !point(file->data, file->size)) {
+		delete file;
+		return false;
+	}
+	delete map;
+	map = file;
+	memory.clear();
+	return true;
+}
+
+bool Level::save(const char* filename) const {
+	FILE* output = fopen(filename, "wb");
+	if (output == NULL)
+		return false;
+	bool ok = fwrite(head, 1, head->size, output) == (size_t)head->size;
+	return fclose(output) == 0 && ok;
+}
+
+LevelHeader &Level::editHeader() {
+	if (map != NULL)
+		copy((const char*)head, head->size);
+	return *(LevelHeader*)head;
+}
+
+LevelObstacle* Level::editObstacles(int n) {
+	if (map != NULL)
+		copy((const char*)head, head->size);
+	return (LevelObstacle*)obstacleTable + stageTable[n - 1].firstObstacle;
+}
@@ -0,0 +1,166 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+//The stages, as data.  One table of obstacles per stage says both what the
+//ball runs into (step() in game.cpp, MultiBall) and what is drawn (BatBall()
+//in render.cpp), so a stage is added or changed in one place.
+//
+//A level file is the tables laid out as they are in memory: a LevelHeader,
+//then the stages, obstacles and textures, each found by its byte offset from
+//the start.  Loading one is a single mapping plus turning those offsets into
+//pointers; nothing is parsed or copied.  Like textures.cache the layout is
+//that of the build that wrote it, so files are for the same platform.  Level
+//ships the game's own two stages built in, and save() writes them out as a
+//starting point (dxball_sim level <file>).
+#include <stddef.h>
+#include <vector>
+
+class MappedFile;
+
+//What an obstacle is to the ball
+enum ObstacleKind {
+	OBSTACLE_SCENERY, //Only drawn, e.g. the second blade of a fan
+	OBSTACLE_FAN,     //Deflects the ball crossing the centre line within reach of x
+	OBSTACLE_BARRIER, //Bounces the ball crossing the centre line back while turned flat
+	OBSTACLE_WALL,    //Bounces the ball back once it is past x, while lo <= y <= hi
+	OBSTACLE_WRAP     //Sends the ball past x round to the other side, while lo < y < hi
+};
+
+//Obstacle flags
+enum {
+	FAN_SIDEWAYS = 1 //Gives a ball with no sideways speed stored the default one
+};
+
+//Which of the match's turning angles an obstacle follows
+enum ObstacleSpin {
+	SPIN_NONE,
+	SPIN_FAN,    //GameState::_angle
+	SPIN_BARRIER //GameState::_ang_tri
+};
+
+const int LEVEL_NO_TEXTURE = -1;
+
+struct LevelObstacle {
+	//What the ball runs into.  Fans and barriers sit on the centre line.
+	//Kept in double, as step() has always compared the ball with them.
+	double x;     //Fan, barrier: its middle.  Wall, wrap: the line, on the side its sign says
+	double reach; //Fan, barrier: how far either side of x it catches the ball
+	double inner; //Fan: within this of x it bounces the ball back.  Barrier: degrees
+	              //either side of flat it blocks.  Wrap: how far in from the far
+	              //line the ball comes back.
+	double lo;    //Wall, wrap: the stretch of y it covers
+	double hi;
+
+	//What is drawn: a unit cube moved to position, tilted by tilt degrees
+	//about x, turned by spinOffset plus spinSign times its angle about
+	//spinAxis (0 x, 1 y, 2 z) and stretched to size.  Nothing if size is 0.
+	float position[3];
+	float size[3];
+	float tilt;
+	float spinOffset;
+	float color[3];
+	int spin;
+	int spinAxis;
+	int spinSign;
+	int texture; //Index in the level's textures, or LEVEL_NO_TEXTURE
+
+	int kind;
+	int flags;
+};
+
+struct LevelStage {
+	double serveY;     //Where the ball is served from
+	int firstObstacle; //Index of its first obstacle
+	int obstacles;     //Number of obstacles
+	int background;    //Textures of the backdrop, the paddles and the ball
+	int paddle;
+	int ball;
+	int unused;        //Keeps the size a multiple of 8
+};
+
+//A bitmap the obstacles and stages refer to by index
+struct LevelTexture {
+	char bmp[32];
+	int width; //As in TextureSpec
+	int height;
+};
+
+struct LevelHeader {
+	char magic[4];     //"DXLV"
+	int version;       //LEVEL_VERSION
+	int size;          //Bytes in the whole level
+	int stageCount;
+	int obstacleCount;
+	int textureCount;
+	int stages;        //Byte offsets of the tables
+	int obstacles;
+	int textures;
+	int unused;
+	double fanTurn;    //Degrees the fans (_angle) turn per tick
+	double barrierTurn;//Degrees the barrier (_ang_tri) turns per tick
+	double barrierServe;//_ang_tri at every serve
+};
+
+const int LEVEL_VERSION = 1;
+
+class Level {
+public:
+	//The game's own stages 1 and 2
+	Level();
+	//An in-memory copy of other, which can be edited
+	Level(const Level &other);
+	~Level();
+
+	//The same level every match defaults to
+	static const Level &builtIn();
+
+	//Maps filename and uses it from then on.  Returns false, leaving the
+	//level as it was, if the file cannot be read or is not a level this
+	//build can use.
+	bool load(const char* filename);
+
+	//Writes the level out for load()
+	bool save(const char* filename) const;
+
+	const LevelHeader &header() const {
+		return *head;
+	}
+
+	int stageCount() const {
+		return head->stageCount;
+	}
+
+	//Stage n, numbered from 1 as GameState::stage is
+	const LevelStage &stage(int n) const {
+		return stageTable[n - 1];
+	}
+
+	//The obstacles of stage n; stage(n).obstacles of them
+	const LevelObstacle* obstacles(int n) const {
+		return obstacleTable + stageTable[n - 1].firstObstacle;
+	}
+
+	const LevelTexture &texture(int i) const {
+		return textureTable[i];
+	}
+
+	//Writable views, for tools that try changes to a level (dxball_tune).  A
+	//mapped level is copied into memory first.
+	LevelHeader &editHeader();
+	LevelObstacle* editObstacles(int n);
+private:
+	std::vector<double> memory; //An unmapped level; double keeps it aligned
+	MappedFile* map;
+	const LevelHeader* head;
+	const LevelStage* stageTable;
+	const LevelObstacle* obstacleTable;
+	const LevelTexture* textureTable;
+
+	//Checks the level at data and points the tables into it
+	bool point(const char* data, size_t size);
+	void copy(const char* data, size_t size);
+
+	void operator=(const Level &);
+};
+
+#endif
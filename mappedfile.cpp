@@ -0,0 +1,56 @@
+#include "mappedfile.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* filename) : data(NULL), size(0) {
+#ifdef _WIN32
+	mapping = NULL;
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+		return;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return;
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data != NULL)
+		size = (size_t)length.QuadPart;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			data = (const char*)p;
+			size = (size_t)info.st_size;
+		}
+	}
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+#else
+	if (data != NULL)
+		munmap((void*)data, size);
+#endif
+}
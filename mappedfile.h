@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+//A whole file mapped read-only into memory
+class MappedFile {
+public:
+	MappedFile(const char* filename);
+	~MappedFile();
+
+	//NULL if the file could not be opened
+	const char* data;
+	size_t size;
+private:
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+
+	MappedFile(const MappedFile &);
+	void operator=(const MappedFile &);
+};
+
+#endif
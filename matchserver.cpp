@@ -0,0 +1,113 @@
+#include "matchserver.h"
+#include "bot.h"
+
+MatchLag::MatchLag() : ticks(0), late(0), meanMs(0), maxMs(0), lastMs(0) {
+
+}
+
+MatchServer::MatchServer(int count, unsigned int seed, const GameParams* params, bool bots) :
+	bots(bots), running(false), nextTicket(0), ticksRun(0) {
+	for (int i = 0; i < count; i++) {
+		Match* m = new Match;
+		m->game = GameState(matchSeed(seed, i), params);
+		m->lagSum = 0;
+		matches.push_back(m);
+	}
+	//Match i starts in slot i % SLOTS
+	for (int slot = 0; slot < SLOTS; slot++) {
+		for (int i = slot; i < count; i += SLOTS)
+			order.push_back(i);
+	}
+}
+
+MatchServer::~MatchServer() {
+	stop();
+	for (size_t i = 0; i < matches.size(); i++)
+		delete matches[i];
+}
+
+void MatchServer::start(int threads) {
+	stop();
+	if (matches.empty())
+		return;
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+	//Carries on from the round the last run stopped in, so no match ticks
+	//twice in a period
+	long rounds = (nextTicket.load() + (long)matches.size() - 1) / (long)matches.size();
+	nextTicket = rounds * (long)matches.size();
+	epoch = Clock::now() - std::chrono::milliseconds(rounds * PERIOD_MS);
+	running = true;
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&MatchServer::work, this));
+}
+
+void MatchServer::stop() {
+	running = false;
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+bool MatchServer::addInput(int match, InputType input) {
+	Match &m = *matches[match];
+	std::lock_guard<std::mutex> guard(m.lock);
+	return m.pending.push(input);
+}
+
+GameState MatchServer::state(int match) {
+	Match &m = *matches[match];
+	std::lock_guard<std::mutex> guard(m.lock);
+	return m.game;
+}
+
+MatchLag MatchServer::lag(int match) {
+	Match &m = *matches[match];
+	std::lock_guard<std::mutex> guard(m.lock);
+	MatchLag lag = m.lag;
+	lag.meanMs = lag.ticks > 0 ? m.lagSum / lag.ticks : 0;
+	return lag;
+}
+
+void MatchServer::work() {
+	while (running) {
+		long first = nextTicket.fetch_add(CHUNK);
+		for (long t = first; t < first + CHUNK; t++)
+			tick(t);
+	}
+}
+
+//Runs the tick the ticket is for once it is due
+void MatchServer::tick(long ticket) {
+	long count = (long)matches.size();
+	long round = ticket / count;
+	int index = order[ticket % count];
+	long slot = index % SLOTS;
+	Clock::time_point due = epoch + std::chrono::microseconds(round * PERIOD_MS * 1000 +
+		slot * PERIOD_MS * 1000 / SLOTS);
+	std::this_thread::sleep_until(due);
+
+	Match &m = *matches[index];
+	std::lock_guard<std::mutex> guard(m.lock);
+	double lagMs = std::chrono::duration<double, std::milli>(Clock::now() - due).count();
+	Inputs inputs = m.pending;
+	m.pending = Inputs();
+	if (bots) {
+		if (m.game.pause != 0)
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+		botInputs(m.game, SIDE_BOTTOM, inputs);
+		botInputs(m.game, SIDE_TOP, inputs);
+	}
+	step(m.game, inputs);
+
+	m.lag.ticks++;
+	if (lagMs >= PERIOD_MS)
+		m.lag.late++;
+	if (lagMs > m.lag.maxMs)
+		m.lag.maxMs = lagMs;
+	m.lag.lastMs = lagMs;
+	m.lagSum += lagMs;
+	ticksRun++;
+}
@@ -0,0 +1,95 @@
+#ifndef MATCHSERVER_H
+#define MATCHSERVER_H
+
+//Hosts many matches in one process, each ticking in real time at 40 ticks
+//a second like the game does, on a pool of threads.  Needs game.cpp,
+//level.cpp, mappedfile.cpp, bot.cpp and C++11 threads.
+//
+//The 25 ms period is cut into SLOTS and the matches are spread over them,
+//so the ticks due come in an even stream rather than all at once.  Every
+//tick due is a ticket; workers take them in order, earliest due first, and
+//step the match once when its time comes.  A worker that falls behind takes
+//tickets already due and runs them back to back until it has caught up, so
+//a match that was late still gets all its ticks.
+//
+//Lag is how long after it was due a tick started.  Each match keeps its own
+//(lag()), so one slow match shows up even when the rest are on time.
+#include "game.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//How late one match's ticks have been
+struct MatchLag {
+	MatchLag();
+
+	long ticks;
+	long late;     //Ticks that started a whole period or more after they were due
+	double meanMs;
+	double maxMs;
+	double lastMs; //Of the latest tick
+};
+
+class MatchServer {
+public:
+	static const int PERIOD_MS = 25;
+	static const int SLOTS = 25; //Starts per period the matches are spread over
+	static const int CHUNK = 8;  //Tickets a worker takes at a time
+
+	//matches matches seeded with matchSeed(seed, i), with params (the
+	//defaults if null).  With bots the computer plays both sides and serves.
+	MatchServer(int matches, unsigned int seed, const GameParams* params = 0, bool bots = false);
+	~MatchServer();
+
+	//Starts ticking on threads workers (0 for one per core)
+	void start(int threads = 0);
+	//Waits for the workers to finish the ticks they hold
+	void stop();
+
+	int size() const {
+		return (int)matches.size();
+	}
+
+	//Queues an input for the match's next tick.  False if the tick is full.
+	bool addInput(int match, InputType input);
+
+	//A copy of the match as of its latest tick
+	GameState state(int match);
+
+	MatchLag lag(int match);
+
+	//Ticks run over all matches
+	long ticks() const {
+		return ticksRun.load();
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Match {
+		std::mutex lock;
+		GameState game;
+		Inputs pending;
+		MatchLag lag;
+		double lagSum;
+	};
+
+	std::vector<Match*> matches;
+	std::vector<int> order; //Matches by slot: the order their tickets come in
+	bool bots;
+	std::vector<std::thread> workers;
+	std::atomic<bool> running;
+	std::atomic<long> nextTicket;
+	std::atomic<long> ticksRun;
+	Clock::time_point epoch; //When the first tick of slot 0 was due
+
+	void work();
+	void tick(long ticket);
+
+	MatchServer(const MatchServer &);
+	void operator=(const MatchServer &);
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "multiball.h"
+#include "level.h"
+#include <math.h>
+
+const float MultiBall::RADIUS = .5f;
+
+namespace {
+	//Grid of 1 x 1 cells, a ball across, over the field and a cell beyond
+	const float GRID_LEFT = -11;
+	const float GRID_BOTTOM = -9.5f;
+	const int GRID_WIDTH = 22;
+	const int GRID_HEIGHT = 19;
+	const int CELLS = GRID_WIDTH * GRID_HEIGHT;
+
+	//Balls of a neighbouring cell each ball is tested against at most.  A
+	//cell holds about one ball up to some 400 balls in all; past that they
+	//pile up, and without the bound the tests would grow with the square of
+	//the count.
+	const int PAIRS_PER_CELL = 6;
+
+	//Fans and ball to ball contacts can only speed a ball up so far
+	const float MAX_SPEED = .9f;
+
+	float limit(float speed) {
+		return speed > MAX_SPEED ? MAX_SPEED : speed < -MAX_SPEED ? -MAX_SPEED : speed;
+	}
+
+	//What a ball in a cell may touch.  A ball moves at most a cell per tick
+	//(MAX_SPEED), so a cell is marked if it or a neighbour overlaps the thing.
+	enum {
+		NEAR_CENTER = 1,  //Centre line: fans and barrier
+		NEAR_PADDLES = 2, //Either paddle line
+		NEAR_SCORE = 4    //Past a scoring line
+	};
+
+	int cellColumn(float x) {
+		int c = (int)floorf(x - GRID_LEFT);
+		return c < 0 ? 0 : c >= GRID_WIDTH ? GRID_WIDTH - 1 : c;
+	}
+
+	int cellRow(float y) {
+		int r = (int)floorf(y - GRID_BOTTOM);
+		return r < 0 ? 0 : r >= GRID_HEIGHT ? GRID_HEIGHT - 1 : r;
+	}
+
+	//Whether [lo, hi] overlaps cell number cell of a grid starting at
+	//gridStart, give or take a cell
+	bool overlaps(float lo, float hi, float gridStart, int cell) {
+		return hi >= gridStart + cell - 1 && lo <= gridStart + cell + 2;
+	}
+
+	//Swept band test, see crossesBand() in game.cpp
+	bool crossesBand(float px, float py, float bx, float by, double lo, double hi, float &x, bool &over) {
+		over = false;
+		if (by < hi && by > lo) {
+			x = bx;
+			return true;
+		}
+		if (!(py >= hi && by <= lo) && !(py <= lo && by >= hi))
+			return false;
+		double t = ((lo + hi) / 2 - py) / (by - py);
+		x = (float)(px + t * (bx - px));
+		over = true;
+		return true;
+	}
+}
+
+MultiBall::MultiBall(int count, unsigned int seed) : x(count), y(count), prevx(count), prevy(count),
+	xspeed(count), yspeed(count), storex(count), score1(0), score2(0), contacts(0),
+	rng(seed != 0 ? seed : 1), cellOf(count), cellStart(CELLS + 1), cellBalls(count), cellNear(CELLS) {
+	GameParams params;
+	for (int i = 0; i < count; i++)
+		serve(i, params);
+
+	for (int r = 0; r < GRID_HEIGHT; r++) {
+		for (int c = 0; c < GRID_WIDTH; c++) {
+			unsigned char near = 0;
+			if (overlaps(-.1f, .1f, GRID_BOTTOM, r))
+				near |= NEAR_CENTER;
+			if (overlaps(-7.8f, -7.6f, GRID_BOTTOM, r) || overlaps(7.6f, 7.8f, GRID_BOTTOM, r))
+				near |= NEAR_PADDLES;
+			if (overlaps(-1e9f, -8.3f, GRID_BOTTOM, r) || overlaps(8.3f, 1e9f, GRID_BOTTOM, r))
+				near |= NEAR_SCORE;
+			cellNear[r * GRID_WIDTH + c] = near;
+		}
+	}
+}
+
+int MultiBall::random() {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return (int)(rng >> 1);
+}
+
+//Back to the centre line somewhere in the middle, heading up or down
+void MultiBall::serve(int i, const GameParams &params) {
+	x[i] = prevx[i] = (float)(random() % 8001 - 4000) / 1000;
+	y[i] = prevy[i] = 0;
+	xspeed[i] = 0;
+	yspeed[i] = (float)(random() % 2 == 0 ? params.serveSpeed : -params.serveSpeed);
+	storex[i] = 0;
+}
+
+//Counting sort of the balls into their cells
+void MultiBall::bin() {
+	int count = size();
+	for (int c = 0; c <= CELLS; c++)
+		cellStart[c] = 0;
+	for (int i = 0; i < count; i++) {
+		cellOf[i] = cellRow(y[i]) * GRID_WIDTH + cellColumn(x[i]);
+		cellStart[cellOf[i] + 1]++;
+	}
+	for (int c = 0; c < CELLS; c++)
+		cellStart[c + 1] += cellStart[c];
+	//cellStart[c] is used as the next free slot of c, then put back
+	for (int i = 0; i < count; i++)
+		cellBalls[cellStart[cellOf[i]]++] = i;
+	for (int c = CELLS; c > 0; c--)
+		cellStart[c] = cellStart[c - 1];
+	cellStart[0] = 0;
+}
+
+//Balls that overlap and are closing bounce off each other like equal
+//billiard balls: they swap their speeds along the line between them.  In a
+//crowded cell each ball is tested against the PAIRS_PER_CELL balls that
+//follow it in the other cell, wrapping round, so every ball still gets
+//some contacts and the crowd pushes apart over a few ticks.
+void MultiBall::collideBalls() {
+	//Each pair is looked at once: a cell with itself and with the neighbours
+	//to its right and above
+	static const int NEIGHBOURS[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+	const float reach = 4 * RADIUS * RADIUS;
+	for (int r = 0; r < GRID_HEIGHT; r++) {
+		for (int c = 0; c < GRID_WIDTH; c++) {
+			int cell = r * GRID_WIDTH + c;
+			for (int n = -1; n < 4; n++) {
+				int other = cell;
+				if (n >= 0) {
+					int oc = c + NEIGHBOURS[n][0];
+					int orow = r + NEIGHBOURS[n][1];
+					if (oc < 0 || oc >= GRID_WIDTH || orow >= GRID_HEIGHT)
+						continue;
+					other = orow * GRID_WIDTH + oc;
+				}
+				int first = cellStart[other];
+				int otherSize = cellStart[other + 1] - first;
+				for (int a = cellStart[cell]; a < cellStart[cell + 1]; a++) {
+					int i = cellBalls[a];
+					//Within a cell the pairs after a, so each is looked at once
+					int tests = other == cell ? cellStart[cell + 1] - a - 1 : otherSize;
+					if (tests > PAIRS_PER_CELL)
+						tests = PAIRS_PER_CELL;
+					int from = other == cell ? a + 1 - first : a - cellStart[cell];
+					for (int t = 0; t < tests; t++) {
+						int j = cellBalls[first + (from + t) % otherSize];
+						float dx = x[j] - x[i];
+						float dy = y[j] - y[i];
+						float d2 = dx * dx + dy * dy;
+						if (d2 >= reach || d2 == 0)
+							continue;
+						float closing = (xspeed[j] - xspeed[i]) * dx + (yspeed[j] - yspeed[i]) * dy;
+						if (closing >= 0)
+							continue;
+						float k = closing / d2;
+						xspeed[i] += k * dx;
+						yspeed[i] += k * dy;
+						xspeed[j] -= k * dx;
+						yspeed[j] -= k * dy;
+						contacts++;
+					}
+				}
+			}
+		}
+	}
+}
+
+//See fanEffect() in game.cpp
+void MultiBall::fan(int i, float x0, double center, double inner, bool middle, const GameParams &params) {
+	bool flipped = false;
+	if (xspeed[i] == 0) {
+		float side = storex[i] == 0 && middle ? (float)params.sideSpeed : storex[i];
+		xspeed[i] = random() % 2 == 0 ? -side : side;
+	}
+	else if (random() % 2 == 0) {
+		xspeed[i] = -xspeed[i];
+		flipped = true;
+	}
+	else if (yspeed[i] != 0) {
+		float up = (float)params.fanSpeedUp;
+		xspeed[i] += xspeed[i] > 0 ? up : -up;
+		yspeed[i] += yspeed[i] > 0 ? up : -up;
+	}
+	if (!flipped && x0 <= center + inner && x0 >= center - inner)
+		xspeed[i] = -xspeed[i];
+}
+
+//See the barrier in step()
+void MultiBall::barrier(int i, bool over, const GameParams &params) {
+	yspeed[i] = -yspeed[i];
+	if (over)
+		y[i] = -y[i];
+	if (xspeed[i] == 0) {
+		float side = storex[i] == 0 ? (float)params.sideSpeed : storex[i];
+		xspeed[i] = random() % 2 == 0 ? side : -side;
+	}
+	else if (random() % 2 == 0)
+		xspeed[i] = -xspeed[i];
+}
+
+//See paddleEffect() in game.cpp
+void MultiBall::paddle(int i, int tilt, const GameParams &params) {
+	float side = storex[i] == 0 ? (float)params.sideSpeed : fabsf(storex[i]);
+	int choice = random() % 3 + 1;
+	if (tilt < 0)
+		xspeed[i] = xspeed[i] == 0 ? side : fabsf(xspeed[i]);
+	else if (tilt > 0)
+		xspeed[i] = xspeed[i] == 0 ? -side : -fabsf(xspeed[i]);
+	else if (xspeed[i] == 0) {
+		if (choice == 1)
+			xspeed[i] = -side;
+		else if (choice == 2)
+			xspeed[i] = side;
+	}
+	else if (choice == 1)
+		xspeed[i] = -xspeed[i];
+	else if (choice == 2) {
+		storex[i] = xspeed[i];
+		xspeed[i] = 0;
+	}
+	yspeed[i] = -yspeed[i];
+}
+
+void MultiBall::step(const GameState &game) {
+	if (game.pause != 0)
+		return;
+	const GameParams &params = *game.params;
+	int count = size();
+	bin();
+	collideBalls();
+
+	//Only cells next to something are looked at, on the balls' last moves.
+	//The fans and barriers of the level sit on the centre line.
+	const Level &level = *params.level;
+	const LevelObstacle* obstacles = level.obstacles(game.stage);
+	int obstacleCount = level.stage(game.stage).obstacles;
+	float xbot = toFloat(game.xbot);
+	float xtop = toFloat(game.xtop);
+	for (int cell = 0; cell < CELLS; cell++) {
+		unsigned char near = cellNear[cell];
+		if (near == 0)
+			continue;
+		for (int a = cellStart[cell]; a < cellStart[cell + 1]; a++) {
+			int i = cellBalls[a];
+			float cx;
+			bool over;
+			if ((near & NEAR_CENTER) != 0 && crossesBand(prevx[i], prevy[i], x[i], y[i], -.1, .1, cx, over)) {
+				for (int k = 0; k < obstacleCount; k++) {
+					const LevelObstacle &o = obstacles[k];
+					if (o.kind == OBSTACLE_FAN && cx <= o.x + o.reach && cx >= o.x - o.reach)
+						fan(i, cx, o.x, o.inner, (o.flags & FAN_SIDEWAYS) != 0, params);
+					else if (o.kind == OBSTACLE_BARRIER && cx <= o.x + o.reach && cx >= o.x - o.reach &&
+						barrierClosed(game._ang_tri, o.inner))
+						barrier(i, over, params);
+				}
+			}
+			if ((near & NEAR_PADDLES) != 0) {
+				if (crossesBand(prevx[i], prevy[i], x[i], y[i], -7.8, -7.6, cx, over) && cx <= xbot + 2 && cx >= xbot - 2) {
+					paddle(i, game.kupdown, params);
+					if (over)
+						y[i] = -7.7f * 2 - y[i];
+				}
+				if (crossesBand(prevx[i], prevy[i], x[i], y[i], 7.6, 7.8, cx, over) && cx <= xtop + 2 && cx >= xtop - 2) {
+					paddle(i, game.mupdown, params);
+					if (over)
+						y[i] = 7.7f * 2 - y[i];
+				}
+			}
+			if (y[i] > 8.3f || y[i] < -8.3f) {
+				if (y[i] > 8.3f)
+					score1++;
+				else score2++;
+				serve(i, params);
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		prevx[i] = x[i];
+		prevy[i] = y[i];
+		xspeed[i] = limit(xspeed[i]);
+		yspeed[i] = limit(yspeed[i]);
+		x[i] += xspeed[i];
+		y[i] += yspeed[i];
+	}
+
+	//Walls, for the balls in the columns next to the innermost one, as step()
+	//tests them
+	float wall = 1e9f;
+	for (int k = 0; k < obstacleCount; k++) {
+		const LevelObstacle &o = obstacles[k];
+		if ((o.kind == OBSTACLE_WALL || o.kind == OBSTACLE_WRAP) && fabs(o.x) < wall)
+			wall = (float)fabs(o.x);
+	}
+	for (int cell = 0; cell < CELLS; cell++) {
+		int column = cell % GRID_WIDTH;
+		if (!overlaps(-1e9f, -wall, GRID_LEFT, column) && !overlaps(wall, 1e9f, GRID_LEFT, column))
+			continue;
+		for (int a = cellStart[cell]; a < cellStart[cell + 1]; a++) {
+			int i = cellBalls[a];
+			bool wrapped = false;
+			for (int k = 0; k < obstacleCount && !wrapped; k++) {
+				const LevelObstacle &o = obstacles[k];
+				if (o.kind == OBSTACLE_WRAP && y[i] > o.lo && y[i] < o.hi && (o.x < 0 ? x[i] < o.x : x[i] > o.x)) {
+					x[i] = (float)(o.x < 0 ? -x[i] - o.inner : -x[i] + o.inner);
+					prevx[i] = x[i] - xspeed[i];
+					wrapped = true;
+				}
+			}
+			for (int k = 0; k < obstacleCount && !wrapped; k++) {
+				const LevelObstacle &o = obstacles[k];
+				if (o.kind == OBSTACLE_WALL && y[i] >= o.lo && y[i] <= o.hi && (o.x < 0 ? x[i] < o.x : x[i] > o.x))
+					xspeed[i] = -xspeed[i];
+			}
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef MULTI_BALL_H
+#define MULTI_BALL_H
+
+//Multi-ball party mode: any number of extra balls in one match, playing off
+//its paddles, fans, barrier and walls and off each other.  The match itself
+//(paddles, stage, turning fans) is a GameState stepped as usual; the balls
+//follow the rules of step() in game.cpp, except that a ball that scores is
+//served again on its own rather than resetting the match.
+//
+//The balls are kept as one array per field, and each tick they are sorted
+//into a uniform grid of ball-sized cells.  Only balls in cells next to a
+//paddle line, the centre line, a scoring line or a wall are tested against
+//those, and balls are tested against each other only within neighbouring
+//cells.  The field holds about 400 balls a cell apart; past that the cells
+//crowd, and each ball is tested against a few balls of each neighbouring
+//cell rather than all of them, so a crowd takes a few ticks to push apart.
+//The work per ball is bounded that way; what still grows with the count is
+//cache misses, from some .25 us a ball at 400 balls to .5 us at 10000
+//(5 ms a tick, a fifth of the 25 ms one has).
+//
+//Positions are floats in both builds; unlike the match, the balls are not
+//part of stateHash() or the input log.
+#include "game.h"
+#include <vector>
+
+class MultiBall {
+public:
+	static const float RADIUS; //As drawn
+
+	//count balls (0 or more), served from the centre line
+	MultiBall(int count, unsigned int seed);
+
+	int size() const {
+		return (int)x.size();
+	}
+
+	//Advances every ball by one tick against game as it is after step(),
+	//unless game is paused
+	void step(const GameState &game);
+
+	//One entry per ball
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> prevx; //Where the ball was before its last move
+	std::vector<float> prevy;
+	std::vector<float> xspeed;
+	std::vector<float> yspeed;
+	std::vector<float> storex;
+
+	int score1;
+	int score2;
+	long contacts; //Ball to ball, so far
+private:
+	unsigned int rng;
+	//The grid: the balls of cell c are cellBalls[cellStart[c]] up to
+	//cellBalls[cellStart[c + 1]]
+	std::vector<int> cellOf;
+	std::vector<int> cellStart;
+	std::vector<int> cellBalls;
+	std::vector<unsigned char> cellNear; //What the balls of each cell can touch
+
+	int random();
+	void serve(int i, const GameParams &params);
+	void bin();
+	void collideBalls();
+	void fan(int i, float x0, double center, double inner, bool middle, const GameParams &params);
+	void barrier(int i, bool over, const GameParams &params);
+	void paddle(int i, int tilt, const GameParams &params);
+};
+
+#endif
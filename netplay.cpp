@@ -0,0 +1,487 @@
+#include "netplay.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	//A packet: "DXNP", then little-endian 32 bit words: check, seed, sender's
+	//side, tick, ack, advantage, hash tick, hash, first input tick, then a
+	//byte with the number of ticks of inputs and for each tick a count byte
+	//and that many InputType bytes
+	const int PACKET_WORDS = 9;
+	const size_t PACKET_HEADER = 4 + 4 * PACKET_WORDS + 1;
+	const unsigned int PROTOCOL = 1;
+
+	void put32(std::vector<unsigned char> &bytes, unsigned int word) {
+		for (int i = 0; i < 4; i++)
+			bytes.push_back((unsigned char)(word >> (8 * i)));
+	}
+
+	unsigned int get32(const unsigned char* p) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+	}
+
+	unsigned int fnv(unsigned int hash, const void* data, size_t size) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ p[i]) * 16777619u;
+		return hash;
+	}
+
+	//What both sides must agree on for their matches to stay the same: the
+	//protocol and the rules
+	unsigned int sessionCheck(const GameParams &params) {
+		unsigned int rules = paramsHash(params);
+		return fnv(fnv(2166136261u, &PROTOCOL, sizeof(PROTOCOL)), &rules, sizeof(rules));
+	}
+
+	bool sameInputs(const Inputs &a, const Inputs &b) {
+		return a.count == b.count && memcmp(a.types, b.types, a.count) == 0;
+	}
+
+	//The paddle moves among inputs, which a held key or a moving mouse
+	//keeps making
+	Inputs moves(const Inputs &inputs) {
+		Inputs result;
+		for (int i = 0; i < inputs.count; i++) {
+			switch (inputs.types[i]) {
+			case INPUT_BOTTOM_LEFT:
+			case INPUT_BOTTOM_RIGHT:
+			case INPUT_TOP_LEFT:
+			case INPUT_TOP_RIGHT:
+				result.push((InputType)inputs.types[i]);
+				break;
+			}
+		}
+		return result;
+	}
+
+	double nowMs() {
+		static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+NetStats::NetStats() : ticks(0), predicted(0), rollbacks(0), resimulated(0), deepest(0), stalls(0),
+	syncWaits(0), sent(0), dropped(0), received(0), rejected(0), desyncs(0) {
+
+}
+
+Netplay::Netplay() : side(SIDE_BOTTOM), error(NULL), sock(NO_SOCKET), peerAddress(0), peerPort(0),
+	params(NULL), gameSeed(1), check(0), begun(false), lossRng(1), lastSent(0) {
+	reset(1);
+}
+
+Netplay::~Netplay() {
+	close();
+}
+
+bool Netplay::owns(Side side, InputType input) {
+	if (input <= INPUT_BOTTOM_DOWN)
+		return side == SIDE_BOTTOM;
+	if (input <= INPUT_TOP_TILT_RIGHT)
+		return side == SIDE_TOP;
+	return input <= INPUT_STAGE;
+}
+
+bool Netplay::open(Side side_, int port, const char* peer, unsigned int seed, const GameParams* params_) {
+	close();
+	std::string address(peer);
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos)
+		return false;
+	int remotePort = atoi(address.c_str() + colon + 1);
+	address.resize(colon);
+	if (port <= 0 || port > 65535 || remotePort <= 0 || remotePort > 65535)
+		return false;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return false;
+#endif
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* found = NULL;
+	if (getaddrinfo(address.c_str(), NULL, &hints, &found) != 0 || found == NULL)
+		return false;
+	peerAddress = ntohl(((sockaddr_in*)found->ai_addr)->sin_addr.s_addr);
+	peerPort = (unsigned short)remotePort;
+	freeaddrinfo(found);
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons((unsigned short)port);
+#ifdef _WIN32
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	u_long nonBlocking = 1;
+	if (s == INVALID_SOCKET)
+		return false;
+	if (bind(s, (sockaddr*)&local, sizeof(local)) != 0 || ioctlsocket(s, FIONBIO, &nonBlocking) != 0) {
+		closesocket(s);
+		return false;
+	}
+#else
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s < 0)
+		return false;
+	if (bind(s, (sockaddr*)&local, sizeof(local)) != 0 || fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) != 0) {
+		::close(s);
+		return false;
+	}
+#endif
+	sock = (size_t)s;
+
+	side = side_;
+	params = params_;
+	check = sessionCheck(*params);
+	lossRng = 2463534242u ^ (unsigned int)port;
+	begun = false;
+	error = NULL;
+	stats = NetStats();
+	confirmedTicks.clear();
+	delayed.clear();
+	pending = Inputs();
+	reset(seed != 0 ? seed : 1); //0 in a packet means none yet
+	lastSent = nowMs() - HEARTBEAT_MS;
+	return true;
+}
+
+void Netplay::close() {
+	if (sock == NO_SOCKET)
+		return;
+#ifdef _WIN32
+	closesocket((SOCKET)sock);
+	WSACleanup();
+#else
+	::close((int)sock);
+#endif
+	sock = NO_SOCKET;
+}
+
+void Netplay::reset(unsigned int seed) {
+	gameSeed = seed;
+	confirmed = GameState(seed, params);
+	current = confirmed;
+	for (int i = 0; i < WINDOW; i++) {
+		local[i] = Inputs();
+		remote[i].tick = -1;
+	}
+	remoteCount = 0;
+	peerAck = 0;
+	peerTick = 0;
+	peerAdvantage = 0;
+	lastSyncWait = -SYNC_INTERVAL;
+	lastHashTick = -1;
+	hashes[0] = stateHash(confirmed);
+	lastMoves = Inputs();
+	mispredicted = false;
+}
+
+bool Netplay::addLocal(InputType input) {
+	if (!owns(side, input) || pending.count >= SIDE_INPUTS)
+		return false;
+	return pending.push(input);
+}
+
+//The inputs of tick: this side's, and the other side's if they are known or
+//else a prediction, which is kept to check against them when they come
+void Netplay::merge(long tick, Inputs &inputs) {
+	RemoteTick &r = remote[tick % WINDOW];
+	if (r.tick != tick || !r.known) {
+		r.tick = tick;
+		r.known = false;
+		r.predicted = lastMoves;
+	}
+	const Inputs &mine = local[tick % WINDOW];
+	const Inputs &theirs = r.known ? r.inputs : r.predicted;
+	const Inputs &bottom = side == SIDE_BOTTOM ? mine : theirs;
+	const Inputs &top = side == SIDE_BOTTOM ? theirs : mine;
+	for (int i = 0; i < bottom.count; i++)
+		inputs.push((InputType)bottom.types[i]);
+	for (int i = 0; i < top.count; i++)
+		inputs.push((InputType)top.types[i]);
+}
+
+//Moves confirmed on over every tick both sides' inputs are known for
+void Netplay::confirm() {
+	while (confirmed.tick < current.tick && confirmed.tick < remoteCount) {
+		NetTick done;
+		done.tick = confirmed.tick;
+		merge(done.tick, done.inputs);
+		done.scored = step(confirmed, done.inputs, &done.point);
+		hashes[confirmed.tick % WINDOW] = stateHash(confirmed);
+		confirmedTicks.push_back(done);
+	}
+}
+
+//Plays the ticks after confirmed again, with the inputs known now
+void Netplay::rollback() {
+	int depth = (int)(current.tick - confirmed.tick);
+	long target = current.tick;
+	current = confirmed;
+	while (current.tick < target) {
+		Inputs inputs;
+		merge(current.tick, inputs);
+		step(current, inputs);
+	}
+	mispredicted = false;
+	stats.rollbacks++;
+	stats.resimulated += depth;
+	if (depth > stats.deepest)
+		stats.deepest = depth;
+}
+
+bool Netplay::tick() {
+	poll();
+	if (error != NULL || !begun)
+		return false;
+
+	long n = current.tick;
+	if (n - confirmed.tick >= MAX_ROLLBACK || n - peerAck >= WINDOW - 1) {
+		stats.stalls++;
+		send();
+		return false;
+	}
+	//Both sides hear each other a latency late, so the difference of how
+	//far each sees itself ahead is twice the real lead
+	long lead = (n - peerTick) - peerAdvantage;
+	if (lead >= 3 && n - lastSyncWait >= SYNC_INTERVAL) {
+		lastSyncWait = n;
+		stats.syncWaits++;
+		send();
+		return false;
+	}
+
+	local[n % WINDOW] = pending;
+	pending = Inputs();
+	Inputs inputs;
+	merge(n, inputs);
+	if (!remote[n % WINDOW].known)
+		stats.predicted++;
+	step(current, inputs);
+	stats.ticks++;
+	confirm();
+	send();
+	return true;
+}
+
+bool Netplay::settled(long ticks) const {
+	return confirmed.tick >= ticks && peerAck >= ticks;
+}
+
+void Netplay::send() {
+	long first = peerAck < current.tick ? peerAck : current.tick;
+	std::vector<unsigned char> bytes;
+	bytes.reserve(PACKET_HEADER + (current.tick - first) * (1 + SIDE_INPUTS));
+	bytes.push_back('D');
+	bytes.push_back('X');
+	bytes.push_back('N');
+	bytes.push_back('P');
+	put32(bytes, check);
+	put32(bytes, side == SIDE_TOP && !begun ? 0 : gameSeed); //The top side has none yet
+	put32(bytes, side);
+	put32(bytes, (unsigned int)current.tick);
+	put32(bytes, (unsigned int)remoteCount);
+	put32(bytes, (unsigned int)(current.tick - peerTick));
+	put32(bytes, (unsigned int)confirmed.tick);
+	put32(bytes, hashes[confirmed.tick % WINDOW]);
+	put32(bytes, (unsigned int)first);
+	bytes.push_back((unsigned char)(current.tick - first));
+	for (long t = first; t < current.tick; t++) {
+		const Inputs &inputs = local[t % WINDOW];
+		bytes.push_back((unsigned char)inputs.count);
+		bytes.insert(bytes.end(), inputs.types, inputs.types + inputs.count);
+	}
+	transmit(bytes);
+	lastSent = nowMs();
+}
+
+double Netplay::random() {
+	lossRng ^= lossRng << 13;
+	lossRng ^= lossRng >> 17;
+	lossRng ^= lossRng << 5;
+	return (lossRng >> 8) / 16777216.0;
+}
+
+//Sends bytes to the peer, through the injector
+void Netplay::transmit(const std::vector<unsigned char> &bytes) {
+	if (conditions.lossPercent > 0 && random() * 100 < conditions.lossPercent) {
+		stats.dropped++;
+		return;
+	}
+	double hold = conditions.delayMs + (conditions.jitterMs > 0 ? random() * conditions.jitterMs : 0);
+	if (hold > 0) {
+		DelayedPacket packet;
+		packet.due = nowMs() + hold;
+		packet.bytes = bytes;
+		delayed.push_back(packet);
+	}
+	else sendNow(bytes);
+}
+
+void Netplay::sendNow(const std::vector<unsigned char> &bytes) {
+	sockaddr_in to;
+	memset(&to, 0, sizeof(to));
+	to.sin_family = AF_INET;
+	to.sin_addr.s_addr = htonl(peerAddress);
+	to.sin_port = htons(peerPort);
+#ifdef _WIN32
+	sendto((SOCKET)sock, (const char*)&bytes[0], (int)bytes.size(), 0, (sockaddr*)&to, sizeof(to));
+#else
+	sendto((int)sock, &bytes[0], bytes.size(), 0, (sockaddr*)&to, sizeof(to));
+#endif
+	stats.sent++;
+}
+
+void Netplay::poll() {
+	if (sock == NO_SOCKET)
+		return;
+	double now = nowMs();
+	for (size_t i = 0; i < delayed.size();) {
+		if (delayed[i].due <= now) {
+			sendNow(delayed[i].bytes);
+			delayed.erase(delayed.begin() + i);
+		}
+		else i++;
+	}
+
+	unsigned char buffer[2048];
+	for (;;) {
+		sockaddr_in from;
+		socklen_t fromSize = sizeof(from);
+#ifdef _WIN32
+		int size = recvfrom((SOCKET)sock, (char*)buffer, sizeof(buffer), 0, (sockaddr*)&from, &fromSize);
+#else
+		ssize_t size = recvfrom((int)sock, buffer, sizeof(buffer), 0, (sockaddr*)&from, &fromSize);
+#endif
+		if (size < 0)
+			break;
+		if (ntohl(from.sin_addr.s_addr) != peerAddress || ntohs(from.sin_port) != peerPort) {
+			stats.rejected++;
+			continue;
+		}
+		receive(buffer, (size_t)size);
+	}
+	if (begun) {
+		confirm();
+		if (mispredicted)
+			rollback();
+	}
+
+	if (nowMs() - lastSent >= HEARTBEAT_MS)
+		send();
+}
+
+void Netplay::receive(const unsigned char* data, size_t size) {
+	if (size < PACKET_HEADER || memcmp(data, "DXNP", 4) != 0) {
+		stats.rejected++;
+		return;
+	}
+	unsigned int words[PACKET_WORDS];
+	for (int i = 0; i < PACKET_WORDS; i++)
+		words[i] = get32(data + 4 + 4 * i);
+	unsigned int packetSeed = words[1];
+	long tick = (int)words[3];
+	long ack = (int)words[4];
+	int advantage = (int)words[5];
+	long hashTick = (int)words[6];
+	long first = (int)words[8];
+	int ticks = data[PACKET_HEADER - 1];
+
+	if (words[0] != check) {
+		error = "the other side plays a different level, balance or build";
+		return;
+	}
+	if (words[2] == (unsigned int)side) {
+		error = "both sides play the same paddle";
+		return;
+	}
+	if (words[2] > SIDE_TOP || tick < 0 || ack < 0 || first < 0 || hashTick < 0 || first + ticks > tick ||
+		(begun && packetSeed != 0 && packetSeed != gameSeed) || (side == SIDE_TOP && packetSeed == 0)) {
+		stats.rejected++; //Damaged, or left over from an earlier session
+		return;
+	}
+
+	//Checked in full before any of it is used
+	Side other = side == SIDE_BOTTOM ? SIDE_TOP : SIDE_BOTTOM;
+	const unsigned char* p = data + PACKET_HEADER;
+	const unsigned char* end = data + size;
+	for (int i = 0; i < ticks; i++) {
+		if (p >= end || *p > SIDE_INPUTS || p + 1 + *p > end) {
+			stats.rejected++;
+			return;
+		}
+		for (int k = 1; k <= *p; k++) {
+			if (p[k] > INPUT_STAGE || !owns(other, (InputType)p[k])) {
+				stats.rejected++;
+				return;
+			}
+		}
+		p += 1 + *p;
+	}
+	stats.received++;
+
+	if (!begun) {
+		if (side == SIDE_TOP) {
+			Inputs queued = pending;
+			reset(packetSeed);
+			pending = queued;
+		}
+		begun = true;
+	}
+	if (tick >= peerTick) {
+		peerTick = tick;
+		peerAdvantage = advantage;
+	}
+	long acked = ack < current.tick ? ack : current.tick;
+	if (acked > peerAck)
+		peerAck = acked;
+
+	p = data + PACKET_HEADER;
+	for (long t = first; t < first + ticks; p += 1 + *p, t++) {
+		if (t < confirmed.tick || t >= confirmed.tick + WINDOW)
+			continue;
+		RemoteTick &r = remote[t % WINDOW];
+		if (r.tick == t && r.known)
+			continue;
+		Inputs inputs;
+		for (int k = 1; k <= *p; k++)
+			inputs.push((InputType)p[k]);
+		if (r.tick == t && t < current.tick && !sameInputs(inputs, r.predicted))
+			mispredicted = true;
+		r.tick = t;
+		r.known = true;
+		r.inputs = inputs;
+	}
+	while (remoteCount < confirmed.tick + WINDOW && remote[remoteCount % WINDOW].tick == remoteCount &&
+		remote[remoteCount % WINDOW].known) {
+		lastMoves = moves(remote[remoteCount % WINDOW].inputs);
+		remoteCount++;
+	}
+
+	//A top side without the seed yet has no match to compare
+	if (packetSeed != 0 && hashTick > lastHashTick && hashTick <= confirmed.tick &&
+		hashTick > confirmed.tick - WINDOW) {
+		lastHashTick = hashTick;
+		if (hashes[hashTick % WINDOW] != words[7])
+			stats.desyncs++;
+	}
+}
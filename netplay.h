@@ -0,0 +1,186 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+//Two-player netplay with rollback.  Each side runs the match itself and
+//sends the other its own inputs over UDP; the inputs of a tick are always
+//the bottom side's, then the top side's.  A side does not wait for the
+//other's inputs: it predicts them, plays on, and when they turn out
+//different plays the ticks since the last confirmed one again.  That hides
+//latency up to the rollback window (MAX_ROLLBACK ticks); beyond it a side
+//waits.
+//
+//Paddle moves arrive a step at a time while a key is held or the mouse
+//moves, so the prediction repeats the other side's last known moves and
+//nothing else.  A pause, stage change or speed change shows up when it is
+//confirmed.
+//
+//Every packet carries all of a side's inputs the other has not yet
+//acknowledged, so a lost packet is covered by the next one, and the hash of
+//the sender's last confirmed state, so the sides notice if they drift apart.
+//conditions delays, jitters and drops outgoing packets, so latency and loss
+//can be tried out on one machine over loopback (dxball_sim net, dxball -net).
+//Needs C++11.
+#include "game.h"
+#include "bot.h"
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+//What the injector does to every packet sent
+struct NetConditions {
+	NetConditions() : delayMs(0), jitterMs(0), lossPercent(0) {
+	}
+
+	double delayMs;     //Held back this long
+	double jitterMs;    //Plus up to this much more at random, so packets can overtake each other
+	double lossPercent; //Dropped instead, at random
+};
+
+struct NetStats {
+	NetStats();
+
+	long ticks;       //Ticks run
+	long predicted;   //Ticks run before the other side's inputs for them were known
+	long rollbacks;   //Times a prediction turned out wrong
+	long resimulated; //Ticks played again after those
+	int deepest;      //Most ticks played again at once
+	long stalls;      //Ticks waited because the other side was a whole window behind
+	long syncWaits;   //Ticks waited to let the other side catch up
+	long sent;
+	long dropped;     //By the injector
+	long received;
+	long rejected;    //Not from the other side, or not valid
+	long desyncs;     //Confirmed states found to differ between the sides
+};
+
+//A tick both sides' inputs are known for
+struct NetTick {
+	long tick;      //GameState::tick before it ran
+	Inputs inputs;
+	bool scored;
+	PointRecord point; //If scored
+};
+
+class Netplay {
+public:
+	static const int MAX_ROLLBACK = 12;  //Ticks played ahead of the other side's inputs at most (300 ms)
+	static const int WINDOW = 32;        //Ticks of inputs kept; more than twice MAX_ROLLBACK
+	static const int SIDE_INPUTS = MAX_TICK_INPUTS / 2; //Inputs per side per tick
+	static const int SYNC_INTERVAL = 10; //Ticks between waits to let the other side catch up
+	static const int HEARTBEAT_MS = 25;  //Longest gap between packets
+
+	Netplay();
+	~Netplay();
+
+	//Binds the UDP port and plays side against the peer at "host:port".
+	//The bottom side's seed is the match's; the top side takes it from the
+	//bottom's first packet.  params must outlive the session.
+	bool open(Side side, int port, const char* peer, unsigned int seed, const GameParams* params);
+	void close();
+
+	bool active() const {
+		return sock != NO_SOCKET;
+	}
+
+	//Whether the other side has been heard from and the match has begun
+	bool started() const {
+		return begun;
+	}
+
+	//Whether side may make input
+	static bool owns(Side side, InputType input);
+
+	//Queues an input of this side for the next tick.  False if it moves the
+	//other paddle or the tick is full.
+	bool addLocal(InputType input);
+
+	//Sends packets whose delay is up, reads what has arrived and plays the
+	//match again if a prediction was wrong.  tick() does this too; calling
+	//it between ticks keeps the injector's delays accurate and
+	//acknowledgements flowing.
+	void poll();
+
+	//Runs the next tick with the queued inputs.  False, leaving the match
+	//as it was, if this side has to wait for the other.
+	bool tick();
+
+	//The match as this side sees it, predictions included
+	const GameState &state() const {
+		return current;
+	}
+
+	//The match up to the last tick both sides' inputs are known for
+	const GameState &confirmedState() const {
+		return confirmed;
+	}
+
+	unsigned int seed() const {
+		return gameSeed;
+	}
+
+	//Whether both sides have each other's inputs for every tick before
+	//ticks, i.e. the match can stop there
+	bool settled(long ticks) const;
+
+	Side side;
+	NetConditions conditions;
+	NetStats stats;
+	std::vector<NetTick> confirmedTicks; //Confirmed since the caller last cleared it
+	const char* error; //Why the session cannot go on, or NULL
+private:
+	static const size_t NO_SOCKET = (size_t)-1;
+
+	struct RemoteTick {
+		long tick;        //-1 if the slot is unused
+		bool known;       //Whether inputs came in; else predicted is what was played
+		Inputs inputs;
+		Inputs predicted;
+	};
+
+	struct DelayedPacket {
+		double due;
+		std::vector<unsigned char> bytes;
+	};
+
+	size_t sock;
+	unsigned int peerAddress; //Host byte order
+	unsigned short peerPort;
+	const GameParams* params;
+	unsigned int gameSeed;
+	unsigned int check; //Level and build, which both sides must share
+	bool begun;
+
+	GameState confirmed; //At tick confirmed.tick
+	GameState current;   //At tick current.tick, at most MAX_ROLLBACK ahead
+	Inputs pending;      //This side's inputs for the next tick
+	Inputs local[WINDOW];        //This side's inputs, by tick % WINDOW
+	RemoteTick remote[WINDOW];   //The other side's, by tick % WINDOW
+	long remoteCount;  //The other side's inputs are known for every tick before this
+	long peerAck;      //The other side has ours for every tick before this
+	long peerTick;     //Latest tick the other side said it had reached
+	int peerAdvantage; //How far it said it was ahead of us
+	long lastSyncWait;
+	long lastHashTick; //Of the last state hash compared
+	unsigned int hashes[WINDOW]; //stateHash of confirmed, by tick % WINDOW
+	Inputs lastMoves;  //The other side's paddle moves on its last known tick: the prediction
+	bool mispredicted; //A prediction for a tick already run was wrong
+
+	std::deque<DelayedPacket> delayed;
+	unsigned int lossRng;
+	double lastSent;
+
+	void reset(unsigned int seed);
+	void merge(long tick, Inputs &inputs);
+	void confirm();
+	void rollback();
+	void send();
+	void transmit(const std::vector<unsigned char> &bytes);
+	void sendNow(const std::vector<unsigned char> &bytes);
+	void receive(const unsigned char* data, size_t size);
+	double random();
+
+	Netplay(const Netplay &);
+	void operator=(const Netplay &);
+};
+
+#endif
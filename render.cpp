@@ -0,0 +1,597 @@
+#include "render.h"
+#include "imageloader.h"
+#include "multiball.h"
+#include "level.h"
+#include "glstate.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <math.h>
+#include <vector>
+#ifdef COUNT_GL_CALLS
+#include "glcount.h"
+
+long glCallCounts[GLC_CALLS];
+const char* glCallNames[GLC_CALLS] = {
+	"glBegin", "glBindTexture", "glCallList", "glClear", "glColor3f",
+	"glDisable", "glDisableClientState", "glDrawArrays", "glEnable",
+	"glEnableClientState", "glEnd", "glLoadIdentity", "glMaterialfv",
+	"glMatrixMode", "glNormal3fv", "glNormalPointer", "glPopMatrix",
+	"glPushMatrix", "glRotatef", "glScalef", "glTexCoord2f", "glTranslatef",
+	"glVertex3f", "glVertex3fv", "glVertexPointer" };
+#endif
+
+namespace {
+	//The same unit cube as glutSolidCube(1), so the renderer does not need
+	//GLUT to be initialised
+	const GLfloat CUBE_NORMALS[6][3] = {
+		{ -1, 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const int CUBE_FACES[6][4] = {
+		{ 0, 1, 2, 3 }, { 3, 2, 6, 7 }, { 7, 6, 5, 4 }, { 4, 5, 1, 0 }, { 5, 6, 2, 1 }, { 7, 4, 0, 3 } };
+
+	//Corner i of the cube, numbered as GLUT does: x is high for 4 to 7, y
+	//for 2, 3, 6 and 7 and z for 1, 2, 5 and 6
+	void cubeCorner(int i, GLfloat v[3]) {
+		v[0] = i >= 4 ? .5f : -.5f;
+		v[1] = i % 4 == 2 || i % 4 == 3 ? .5f : -.5f;
+		v[2] = i % 4 == 1 || i % 4 == 2 ? .5f : -.5f;
+	}
+
+	//Triangles with a normal per vertex, drawn from client arrays
+	struct Mesh {
+		std::vector<GLfloat> vertices; //x, y, z of each vertex
+		std::vector<GLfloat> normals;
+
+		void add(const GLfloat v[3], const GLfloat n[3]) {
+			vertices.insert(vertices.end(), v, v + 3);
+			normals.insert(normals.end(), n, n + 3);
+		}
+
+		int count() const {
+			return (int)vertices.size() / 3;
+		}
+	};
+
+	Mesh cubeMesh() {
+		Mesh mesh;
+		static const int TRIANGLES[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 5; i >= 0; i--) {
+			for (int k = 0; k < 6; k++) {
+				GLfloat v[3];
+				cubeCorner(CUBE_FACES[i][TRIANGLES[k]], v);
+				mesh.add(v, CUBE_NORMALS[i]);
+			}
+		}
+		return mesh;
+	}
+
+	//A sphere of radius .5 around the z axis, as gluSphere(quadric, .5,
+	//slices, slices) lays it out
+	Mesh sphereMesh(int slices) {
+		Mesh mesh;
+		const float PI = 3.14159265f;
+		for (int i = 0; i < slices; i++) {
+			for (int j = 0; j < slices; j++) {
+				//The quad between two rings and two meridians, as two triangles
+				static const int CORNERS[6][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 0, 1 } };
+				for (int k = 0; k < 6; k++) {
+					float rho = PI * (i + CORNERS[k][0]) / slices;
+					float theta = 2 * PI * (j + CORNERS[k][1]) / slices;
+					GLfloat n[3] = { sinf(rho) * cosf(theta), sinf(rho) * sinf(theta), -cosf(rho) };
+					GLfloat v[3] = { n[0] * .5f, n[1] * .5f, n[2] * .5f };
+					mesh.add(v, n);
+				}
+			}
+		}
+		return mesh;
+	}
+
+	//A GL modelling transform worked out on the CPU: each call multiplies on
+	//the right, as glTranslatef, glRotatef and glScalef do
+	struct Transform {
+		GLfloat m[3][4]; //Rows; the last column is the translation
+
+		Transform() {
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 4; c++)
+					m[r][c] = r == c ? 1.f : 0.f;
+		}
+
+		Transform &multiply(const GLfloat b[3][4]) {
+			GLfloat out[3][4];
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 4; c++) {
+					out[r][c] = m[r][0] * b[0][c] + m[r][1] * b[1][c] + m[r][2] * b[2][c];
+					if (c == 3)
+						out[r][c] += m[r][3];
+				}
+			}
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 4; c++)
+					m[r][c] = out[r][c];
+			return *this;
+		}
+
+		Transform &translate(float x, float y, float z) {
+			GLfloat b[3][4] = { { 1, 0, 0, x }, { 0, 1, 0, y }, { 0, 0, 1, z } };
+			return multiply(b);
+		}
+
+		//angle degrees around the unit axis (x, y, z)
+		Transform &rotate(float angle, float x, float y, float z) {
+			float a = angle * 3.14159265f / 180;
+			float c = cosf(a), s = sinf(a), t = 1 - c;
+			GLfloat b[3][4] = {
+				{ x * x * t + c, x * y * t - z * s, x * z * t + y * s, 0 },
+				{ y * x * t + z * s, y * y * t + c, y * z * t - x * s, 0 },
+				{ x * z * t - y * s, y * z * t + x * s, z * z * t + c, 0 } };
+			return multiply(b);
+		}
+
+		Transform &scale(float x, float y, float z) {
+			GLfloat b[3][4] = { { x, 0, 0, 0 }, { 0, y, 0, 0 }, { 0, 0, z, 0 } };
+			return multiply(b);
+		}
+	};
+
+	//Copies of a mesh put in place on the CPU and drawn together with one
+	//glDrawArrays(), as instances would be.  The lights and glTexGen work in
+	//eye coordinates, so a copy looks the same as the mesh drawn through the
+	//modelview matrix would.
+	std::vector<GLfloat> batchVertices;
+	std::vector<GLfloat> batchNormals;
+
+	void addInstance(const Mesh &mesh, const Transform &t) {
+		//Normals go through the cofactors of the matrix (its inverse
+		//transpose, up to a scale GL_NORMALIZE takes out), so a stretched
+		//cube stays lit the way glScalef() leaves it
+		GLfloat n[3][3];
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				int r1 = (r + 1) % 3, r2 = (r + 2) % 3, c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+				n[r][c] = t.m[r1][c1] * t.m[r2][c2] - t.m[r1][c2] * t.m[r2][c1];
+			}
+		}
+		size_t base = batchVertices.size();
+		batchVertices.resize(base + mesh.vertices.size());
+		batchNormals.resize(base + mesh.normals.size());
+		for (size_t i = 0; i < mesh.vertices.size(); i += 3) {
+			const GLfloat* v = &mesh.vertices[i];
+			const GLfloat* vn = &mesh.normals[i];
+			for (int r = 0; r < 3; r++) {
+				batchVertices[base + i + r] = t.m[r][0] * v[0] + t.m[r][1] * v[1] + t.m[r][2] * v[2] + t.m[r][3];
+				batchNormals[base + i + r] = n[r][0] * vn[0] + n[r][1] * vn[1] + n[r][2] * vn[2];
+			}
+		}
+	}
+
+	//A copy of mesh moved to (x, y, z), which leaves the normals as they are
+	void addInstance(const Mesh &mesh, float x, float y, float z) {
+		size_t base = batchVertices.size();
+		batchVertices.resize(base + mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); i += 3) {
+			batchVertices[base + i] = mesh.vertices[i] + x;
+			batchVertices[base + i + 1] = mesh.vertices[i + 1] + y;
+			batchVertices[base + i + 2] = mesh.vertices[i + 2] + z;
+		}
+		batchNormals.insert(batchNormals.end(), mesh.normals.begin(), mesh.normals.end());
+	}
+
+	//Draws the copies added since the last call.  The arrays are left
+	//enabled for the next batch; nothing else draws from arrays.
+	void drawBatch() {
+		if (batchVertices.empty())
+			return;
+		glState.enableClientState(GL_VERTEX_ARRAY);
+		glState.enableClientState(GL_NORMAL_ARRAY);
+		glVertexPointer(3, GL_FLOAT, 0, &batchVertices[0]);
+		glNormalPointer(GL_FLOAT, 0, &batchNormals[0]);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(batchVertices.size() / 3));
+		batchVertices.clear();
+		batchNormals.clear();
+	}
+
+	Mesh cube;
+
+	//Spheres from finest to coarsest
+	const int SPHERE_LODS = 5;
+	const int SPHERE_SLICES[SPHERE_LODS] = { 30, 20, 12, 8, 6 };
+	Mesh spheres[SPHERE_LODS];
+
+	//Pixels on screen per world unit, set by reshape()
+	float pixelsPerUnit = 45;
+
+	//Facets are kept at least this many pixels along the equator; finer
+	//than that is not seen
+	const float MIN_FACET = 4;
+	//Sphere vertices per frame beyond which a coarser sphere is used
+	const int SPHERE_BUDGET = 300000;
+
+	//The finest sphere worth drawing count times at the current size.  The
+	//view is orthographic, so how big a ball looks does not depend on where
+	//it is and one level does for every ball in the frame.
+	const Mesh &sphereLod(int count) {
+		float around = 2 * 3.14159265f * MultiBall::RADIUS * pixelsPerUnit;
+		for (int i = 0; i < SPHERE_LODS - 1; i++) {
+			if (around / SPHERE_SLICES[i] >= MIN_FACET && (long)spheres[i].count() * count <= SPHERE_BUDGET)
+				return spheres[i];
+		}
+		return spheres[SPHERE_LODS - 1];
+	}
+
+	//The material of every cube in BatBall()
+	void cubeMaterial() {
+		GLfloat no_mat[] = { 0.0, 0.0, 0.0, 1.0 };
+		GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
+		GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+		GLfloat low_shininess[] = { 5.0 };
+		glState.material(GL_AMBIENT, no_mat);
+		glState.material(GL_DIFFUSE, mat_diffuse);
+		glState.material(GL_SPECULAR, mat_specular);
+		glState.material(GL_SHININESS, low_shininess);
+		glState.material(GL_EMISSION, no_mat);
+	}
+
+	float lerp(float a, float b, float t) {
+		return a + (b - a) * t;
+	}
+
+	//Angles wrap from 360 to just above 0
+	float lerpAngle(float a, float b, float t) {
+		if (b - a < -180)
+			b += 360;
+		float angle = lerp(a, b, t);
+		return angle > 360 ? angle - 360 : angle;
+	}
+
+	//Furthest the ball moves in a tick; a longer move is a jump
+	const float MAX_MOVE = 1;
+}
+
+//Uploads texture i of the cache with all its mipmap levels
+GLuint loadTexture(TextureCache &textures, int i) {
+
+	GLuint textureId;
+
+	glGenTextures(1, &textureId); //Make room for our texture
+
+	glState.bindTexture(textureId); //Tell OpenGL which texture to edit
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //Rows of our images are tightly packed
+
+	for (int level = 0; level < textures.levels(i); level++) {
+		Image* image = textures.image(i, level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, image->width, image->height, 0,
+			GL_RGB, GL_UNSIGNED_BYTE, image->pixels);
+	}
+
+	//Filters belong to the texture, so they are set once here rather than
+	//every time it is bound
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	return textureId; //Returns the id of the texture
+
+}
+
+//One for each texture of the level init() was given, 0 until uploaded
+std::vector<GLuint> levelTextures;
+//Where the textures not yet uploaded come from; NULL once all are
+TextureCache* pendingTextures = NULL;
+
+//The texture object of texture i, uploaded now if it has not been yet
+GLuint levelTexture(int i) {
+	if (levelTextures[i] == 0) {
+		pendingTextures->wait(i);
+		levelTextures[i] = loadTexture(*pendingTextures, i);
+	}
+	return levelTextures[i];
+}
+
+//Display list for the geometry in BatBall() that never changes, built once.
+//The cubes and balls are drawn from the meshes, a batch at a time.
+GLuint _background;  //Drawn with the stage's texture bound
+
+void buildLists()
+{
+	GLfloat mat_ambient[] = { 0.7, 0.7, 0.7, 1.0 };
+	GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
+	GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+	GLfloat low_shininess[] = { 5.0 };
+
+	cube = cubeMesh();
+	for (int i = 0; i < SPHERE_LODS; i++)
+		spheres[i] = sphereMesh(SPHERE_SLICES[i]);
+
+	_background = glGenLists(1);
+	glNewList(_background, GL_COMPILE);
+	glPushMatrix();       /////////STAGE background
+	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
+	glMaterialfv(GL_FRONT, GL_SHININESS, low_shininess);
+	glMaterialfv(GL_FRONT, GL_EMISSION, mat_ambient);
+	glColor3f(1, 1, 1);
+	glBegin(GL_QUADS);
+	//Lit as it always has been, with the normal the last barricade cube
+	//left behind when they were drawn one face at a time
+	glNormal3fv(CUBE_NORMALS[0]);
+	glTexCoord2f(1, 1); glVertex3f(10, 10, -2);
+	glTexCoord2f(1, 0); glVertex3f(10, -10, -2);
+	glTexCoord2f(0, 0); glVertex3f(-10, -10, -2);
+	glTexCoord2f(0, 1); glVertex3f(-10, 10, -2);
+	glEnd();
+	glPopMatrix();
+	glEndList();
+}
+
+void init(const GameState &game)
+{
+	glState.enable(GL_COLOR_MATERIAL);
+	glState.enable(GL_NORMALIZE);
+
+	//The level's textures, built once into textures.cache, then mapped
+	//straight from it.  Only the starting stage's are uploaded here; the
+	//rest are built first if need be and left to uploadTextures().
+	const Level &level = *game.params->level;
+	int count = level.header().textureCount;
+	std::vector<TextureSpec> specs(count);
+	for (int i = 0; i < count; i++) {
+		specs[i].bmp = level.texture(i).bmp;
+		specs[i].width = level.texture(i).width;
+		specs[i].height = level.texture(i).height;
+	}
+	std::vector<bool> starting(count, false);
+	const LevelStage &stage = level.stage(game.stage);
+	int used[] = { stage.background, stage.paddle, stage.ball };
+	for (int i = 0; i < 3; i++) {
+		if (used[i] != LEVEL_NO_TEXTURE)
+			starting[used[i]] = true;
+	}
+	const LevelObstacle* obstacles = level.obstacles(game.stage);
+	for (int i = 0; i < stage.obstacles; i++) {
+		if (obstacles[i].texture != LEVEL_NO_TEXTURE)
+			starting[obstacles[i].texture] = true;
+	}
+	std::vector<int> order;
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < count; i++) {
+			if (starting[i] == (pass == 0))
+				order.push_back(i);
+		}
+	}
+	levelTextures.assign(count, 0);
+	if (count > 0) {
+		pendingTextures = new TextureCache("textures.cache", &specs[0], count, &order[0]);
+		int i = 0;
+		for (; i < count && starting[order[i]]; i++)
+			levelTexture(order[i]);
+		if (i == count) {
+			delete pendingTextures;
+			pendingTextures = NULL;
+		}
+	}
+
+	buildLists();
+
+	GLfloat light_position[] = { 0, 0, 3, .0 };
+	GLfloat red_light_position[] = { toFloat(game.ballx), toFloat(game.bally), 1, .0 };
+	GLfloat blue_light_position[] = { toFloat(game.xtop), 5.3,0., 0.0 };
+	GLfloat white_light[] = { 1, 1, 1, .0 };
+	GLfloat red_light[] = { 1.0, 0.0,0.0, 1.0 };
+	GLfloat blue_light[] = { 0.0, 0.0,1.0, 1.0 };
+	GLfloat lmodel_ambient[] = { 0.2, 0.2, 0.2, 0.2 };
+	glClearColor(0, 0, 0, 0);
+	glShadeModel(GL_SMOOTH);
+
+	glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, white_light);
+	glLightfv(GL_LIGHT0, GL_SPECULAR, white_light);
+
+	glLightfv(GL_LIGHT1, GL_POSITION, red_light_position);
+	glLightfv(GL_LIGHT1, GL_DIFFUSE, red_light);
+	glLightfv(GL_LIGHT1, GL_SPECULAR, red_light);
+
+	glLightfv(GL_LIGHT2, GL_POSITION, blue_light_position);
+	glLightfv(GL_LIGHT2, GL_DIFFUSE, blue_light);
+	glLightfv(GL_LIGHT2, GL_SPECULAR, blue_light);
+
+	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient);
+	glState.enable(GL_LIGHTING);
+	glState.enable(GL_LIGHT0);
+	//glEnable(GL_LIGHT1);
+	//glEnable(GL_LIGHT2);
+	glState.enable(GL_DEPTH_TEST);
+
+}
+
+bool uploadTextures() {
+	if (pendingTextures == NULL)
+		return false;
+	int left = 0;
+	bool uploaded = false;
+	for (size_t i = 0; i < levelTextures.size(); i++) {
+		if (levelTextures[i] != 0)
+			continue;
+		if (!uploaded && pendingTextures->ready((int)i)) {
+			levelTextures[i] = loadTexture(*pendingTextures, (int)i);
+			uploaded = true;
+		}
+		else left++;
+	}
+	//Deleting the cache joins its workers, so not before the last of them
+	//has written it
+	if (left > 0 || !pendingTextures->finished())
+		return true;
+	delete pendingTextures;
+	pendingTextures = NULL;
+	return false;
+}
+
+void finishTextures() {
+	if (pendingTextures == NULL)
+		return;
+	for (size_t i = 0; i < levelTextures.size(); i++)
+		levelTexture((int)i);
+	delete pendingTextures;
+	pendingTextures = NULL;
+}
+
+namespace {
+	//Textures with texture i of the level, coordinates from glTexGen, or
+	//turns texturing off for LEVEL_NO_TEXTURE
+	void useTexture(int i) {
+		if (i == LEVEL_NO_TEXTURE) {
+			glState.disable(GL_TEXTURE_GEN_S); //disable texture coordinate generation
+			glState.disable(GL_TEXTURE_GEN_T);
+			glState.disable(GL_TEXTURE_2D);
+			return;
+		}
+		glState.enable(GL_TEXTURE_2D);
+		glState.enable(GL_TEXTURE_GEN_S); //enable texture coordinate generation
+		glState.enable(GL_TEXTURE_GEN_T);
+		glState.bindTexture(levelTexture(i));
+	}
+
+	//The material and texture of the balls
+	void ballMaterial(const GameState &game) {
+		GLfloat no_mat[] = { 0.0, 0.0, 0.0, 1.0 };
+		GLfloat mat_ambient[] = { 0.7, 0.7, 0.7, 1.0 };
+		GLfloat mat_diffuse[] = { 0.1, 0.5, 0.8, 1.0 };
+		GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
+		GLfloat low_shininess[] = { 5.0 };
+		useTexture(game.params->level->stage(game.stage).ball);
+		glState.material(GL_AMBIENT, mat_ambient);
+		glState.material(GL_DIFFUSE, mat_diffuse);
+		glState.material(GL_SPECULAR, mat_specular);
+		glState.material(GL_SHININESS, low_shininess);
+		glState.material(GL_EMISSION, no_mat);
+		glState.color(1, 1, 1);
+	}
+
+	//Paddle tilt as drawn: a paddle turned by tilt, 20 degrees either way
+	float tiltAngle(int tilt) {
+		return tilt > 0 ? 20.f : tilt < 0 ? -20.f : 0.f;
+	}
+
+	//Where obstacle o is drawn in game
+	Transform place(const LevelObstacle &o, const GameState &game) {
+		float angle = o.spin == SPIN_FAN ? game._angle : o.spin == SPIN_BARRIER ? game._ang_tri : 0;
+		Transform t;
+		t.translate(o.position[0], o.position[1], o.position[2]);
+		if (o.tilt != 0)
+			t.rotate(o.tilt, 1, 0, 0);
+		float spin = o.spinOffset + o.spinSign * angle;
+		if (spin != 0)
+			t.rotate(spin, o.spinAxis == 0 ? 1.f : 0.f, o.spinAxis == 1 ? 1.f : 0.f, o.spinAxis == 2 ? 1.f : 0.f);
+		return t.scale(o.size[0], o.size[1], o.size[2]);
+	}
+
+	bool sameLook(const LevelObstacle &a, const LevelObstacle &b) {
+		return a.texture == b.texture && a.color[0] == b.color[0] && a.color[1] == b.color[1] &&
+			a.color[2] == b.color[2];
+	}
+}
+
+//The stage's obstacles come from the level, drawn a batch for each run of
+//them with the same texture and colour, so a frame is a handful of draws
+//whatever it shows
+void BatBall(const GameState &game) {
+	const Level &level = *game.params->level;
+	const LevelStage &stage = level.stage(game.stage);
+
+	if (stage.background != LEVEL_NO_TEXTURE) {
+		glState.enable(GL_TEXTURE_2D);
+		glState.bindTexture(levelTexture(stage.background));
+	}
+	else glState.disable(GL_TEXTURE_2D);
+	glState.callList(_background);
+
+	useTexture(stage.paddle);
+	cubeMaterial();
+	// BOTTOM PLAYER
+	addInstance(cube, Transform().translate(toFloat(game.xbot), -8.4f, 0).rotate(tiltAngle(game.kupdown), 0, 0, 1).scale(3, 1, 1));
+	// TOP PLAYER
+	addInstance(cube, Transform().translate(toFloat(game.xtop), 8.4f, 0).rotate(-tiltAngle(game.mupdown), 0, 0, 1).scale(3, 1, 1));
+	drawBatch();
+
+	const LevelObstacle* obstacles = level.obstacles(game.stage);
+	const LevelObstacle* look = NULL; //Of the batch being put together
+	for (int i = 0; i < stage.obstacles; i++) {
+		const LevelObstacle &o = obstacles[i];
+		if (o.size[0] == 0 || o.size[1] == 0 || o.size[2] == 0)
+			continue;
+		if (look == NULL || !sameLook(*look, o)) {
+			drawBatch();
+			look = &o;
+			useTexture(o.texture);
+			glState.color(o.color[0], o.color[1], o.color[2]);
+		}
+		addInstance(cube, place(o, game));
+	}
+	drawBatch();
+
+	//sphereeeeeeeeeeeeeeee
+	ballMaterial(game);
+	addInstance(sphereLod(1), toFloat(game.ballx), toFloat(game.bally), 0);
+	drawBatch();
+
+	glState.disable(GL_TEXTURE_GEN_S); //disable texture coordinate generation
+	glState.disable(GL_TEXTURE_GEN_T);
+	glState.disable(GL_TEXTURE_2D);
+}
+
+void reshape(int w, int h)
+{
+	glViewport(0, 0, w, h);
+	glState.matrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	if (w <= (h * 2)) {
+		pixelsPerUnit = w / 20.f;
+		glOrtho(-10.0, 10.0, -4.0*((GLfloat)h * 3) / (GLfloat)w,
+			4.0*((GLfloat)h * 3) / (GLfloat)w, -10.0, 10.0);
+	}
+	else {
+		pixelsPerUnit = h / 6.f;
+		glOrtho(-7.0*(GLfloat)w / ((GLfloat)h * 2),
+			7.0*(GLfloat)w / ((GLfloat)h * 2), -3.0, 3.0, -10.0, 10.0);
+	}
+	glState.matrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+}
+
+GameState interpolate(const GameState &previous, const GameState &game, float t) {
+	GameState view = game;
+	if (previous.stage != game.stage || previous.st != game.st)
+		return view;
+	view.xbot = lerp(toFloat(previous.xbot), toFloat(game.xbot), t);
+	view.xtop = lerp(toFloat(previous.xtop), toFloat(game.xtop), t);
+	view._angle = lerpAngle(previous._angle, game._angle, t);
+	view._ang_tri = lerpAngle(previous._ang_tri, game._ang_tri, t);
+	if (fabs(toFloat(game.ballx) - toFloat(previous.ballx)) < MAX_MOVE &&
+		fabs(toFloat(game.bally) - toFloat(previous.bally)) < MAX_MOVE) {
+		view.ballx = lerp(toFloat(previous.ballx), toFloat(game.ballx), t);
+		view.bally = lerp(toFloat(previous.bally), toFloat(game.bally), t);
+	}
+	return view;
+}
+
+void drawBalls(const GameState &game, const MultiBall &balls, float t) {
+	ballMaterial(game);
+	const Mesh &sphere = sphereLod(balls.size());
+	for (int i = 0; i < balls.size(); i++) {
+		float x = balls.x[i];
+		float y = balls.y[i];
+		if (fabs(x - balls.prevx[i]) < MAX_MOVE && fabs(y - balls.prevy[i]) < MAX_MOVE) {
+			x = lerp(balls.prevx[i], x, t);
+			y = lerp(balls.prevy[i], y, t);
+		}
+		addInstance(sphere, x, y, 0);
+	}
+	drawBatch();
+	glState.disable(GL_TEXTURE_GEN_S);
+	glState.disable(GL_TEXTURE_GEN_T);
+	glState.disable(GL_TEXTURE_2D);
+}
@@ -0,0 +1,38 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+//Draws a match with OpenGL.  Only needs a current GL context, not GLUT, so
+//the game and the offscreen benchmark (bench.cpp) share it.
+#include "game.h"
+
+class MultiBall;
+
+//Loads the textures of game's level, builds the display lists and sets up
+//the lights.  Of the textures only those of game's stage are uploaded; the
+//rest go up in uploadTextures(), or when first drawn.
+void init(const GameState &game);
+
+//Uploads the next texture init() left for later if it is ready.  True while
+//any are left, or the texture cache is still being written; call it between
+//frames until then.  It never waits.
+bool uploadTextures();
+
+//Waits for the textures init() left for later and uploads them all
+void finishTextures();
+
+//Sets the viewport and projection for a w x h window
+void reshape(int w, int h);
+
+//Draws the stage, paddles, barriers, fans and ball of game
+void BatBall(const GameState &game);
+
+//The match t of the way (0 to 1) from previous to game, one tick later, for
+//drawing between ticks.  Jumps (a point, a serve, a wrap through the stage 2
+//walls) are shown as they are rather than smoothed.
+GameState interpolate(const GameState &previous, const GameState &game, float t);
+
+//Draws the extra balls of multi-ball mode over BatBall(game), each t of the
+//way from where it was to where it is
+void drawBalls(const GameState &game, const MultiBall &balls, float t);
+
+#endif
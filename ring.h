@@ -0,0 +1,41 @@
+#ifndef RING_H
+#define RING_H
+
+//Fixed-size single-producer single-consumer queue.  push() and pop() may run
+//on different threads without a lock; push() on a full queue fails rather
+//than wait.  Needs C++11.
+#include <atomic>
+
+template<class T, unsigned int CAPACITY>
+class Ring {
+public:
+	Ring() : head(0), tail(0) {
+	}
+
+	bool push(const T &item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) >= CAPACITY)
+			return false;
+		items[t % CAPACITY] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item) {
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h % CAPACITY];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+private:
+	std::atomic<unsigned int> head; //Next slot to read
+	std::atomic<unsigned int> tail; //Next slot to write
+	T items[CAPACITY];
+
+	Ring(const Ring &);
+	void operator=(const Ring &);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "runner.h"
+#include "game.h"
+#include <mutex>
+#include <thread>
+#include <vector>
+
+RunStats::RunStats() : matches(0), wins1(0), wins2(0), score1(0), score2(0),
+	ticks(0), rallyTicks(0), levelTotal(0), maxLevel(0), capped(0) {
+
+}
+
+void RunStats::add(const RunStats &o) {
+	matches += o.matches;
+	wins1 += o.wins1;
+	wins2 += o.wins2;
+	score1 += o.score1;
+	score2 += o.score2;
+	ticks += o.ticks;
+	rallyTicks += o.rallyTicks;
+	levelTotal += o.levelTotal;
+	if (o.maxLevel > maxLevel)
+		maxLevel = o.maxLevel;
+	capped += o.capped;
+}
+
+namespace {
+	//Matches a worker takes from its own queue at a time
+	const long CHUNK = 16;
+
+	//Matches [next, end) still to be played by one worker.  The owner takes
+	//chunks from the front; an idle worker steals the back half.
+	struct WorkQueue {
+		std::mutex lock;
+		long next;
+		long end;
+		char pad[64]; //Keeps neighbouring queues off each other's cache line
+	};
+
+	//Takes the next chunk of the worker's own queue
+	bool take(WorkQueue &q, long &begin, long &stop) {
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.next >= q.end)
+			return false;
+		begin = q.next;
+		stop = q.next + CHUNK < q.end ? q.next + CHUNK : q.end;
+		q.next = stop;
+		return true;
+	}
+
+	//Moves the back half of victim's queue to mine
+	bool steal(WorkQueue &victim, WorkQueue &mine) {
+		long begin, stop;
+		{
+			std::lock_guard<std::mutex> guard(victim.lock);
+			long left = victim.end - victim.next;
+			if (left <= 0)
+				return false;
+			begin = victim.end - (left + 1) / 2;
+			stop = victim.end;
+			victim.end = begin;
+		}
+		std::lock_guard<std::mutex> guard(mine.lock);
+		mine.next = begin;
+		mine.end = stop;
+		return true;
+	}
+
+	void playMatch(unsigned int seed, int points, const GameParams* params, RunStats &stats) {
+		GameState game(seed, params);
+		PointRecord point;
+		long serve = 0;
+		long limit = points * POINT_TICK_LIMIT;
+		while (game.score1 + game.score2 < points) {
+			if (game.tick >= limit) {
+				stats.capped++;
+				break;
+			}
+			Inputs inputs;
+			if (game.pause != 0)
+				inputs.push(INPUT_PAUSE); //Serve straight away after a point
+			if (step(game, inputs, &point)) {
+				stats.rallyTicks += game.tick - serve;
+				stats.levelTotal += point.level;
+				if (point.level > stats.maxLevel)
+					stats.maxLevel = point.level;
+				serve = game.tick;
+			}
+		}
+		stats.matches++;
+		if (game.score1 > game.score2)
+			stats.wins1++;
+		else if (game.score2 > game.score1)
+			stats.wins2++;
+		stats.score1 += game.score1;
+		stats.score2 += game.score2;
+		stats.ticks += game.tick;
+	}
+
+	void work(int self, std::vector<WorkQueue> &queues, int points,
+		unsigned int seed, const GameParams* params, RunStats &result) {
+		//Totals are kept on the worker's own stack so workers never write to
+		//a shared cache line
+		RunStats stats;
+		int count = (int)queues.size();
+		for (;;) {
+			long begin, stop;
+			while (take(queues[self], begin, stop)) {
+				for (long i = begin; i < stop; i++)
+					playMatch(matchSeed(seed, i), points, params, stats);
+			}
+			bool stolen = false;
+			for (int k = 1; k < count && !stolen; k++)
+				stolen = steal(queues[(self + k) % count], queues[self]);
+			if (!stolen)
+				break;
+		}
+		result = stats;
+	}
+}
+
+RunStats runMatches(long matches, int pointsPerMatch, int threads, unsigned int seed,
+	const GameParams* params) {
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	//Every worker starts with an equal share
+	std::vector<WorkQueue> queues(threads);
+	for (int i = 0; i < threads; i++) {
+		queues[i].next = matches * i / threads;
+		queues[i].end = matches * (i + 1) / threads;
+	}
+
+	std::vector<RunStats> stats(threads);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++)
+		workers.push_back(std::thread(work, i, std::ref(queues), pointsPerMatch, seed, params, std::ref(stats[i])));
+	work(0, queues, pointsPerMatch, seed, params, stats[0]);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	RunStats total;
+	for (int i = 0; i < threads; i++)
+		total.add(stats[i]);
+	return total;
+}
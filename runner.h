@@ -0,0 +1,41 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+//Plays many independent matches on all cores.  Needs game.cpp level.cpp
+//mappedfile.cpp and C++11 threads, e.g.
+//	g++ -O2 -std=c++11 -pthread -o dxball_tune tune.cpp game.cpp runner.cpp level.cpp mappedfile.cpp
+
+struct GameParams;
+
+//Ticks a match may take per point, ten minutes of play.  With params under
+//which nobody scores (no sideways speed, say) a match would never end, so
+//it is stopped there and counted as capped.
+const long POINT_TICK_LIMIT = 40L * 60 * 10;
+
+//Totals over a set of matches
+struct RunStats {
+	RunStats();
+	void add(const RunStats &other);
+
+	long matches;
+	long wins1;      //Matches player ONE won
+	long wins2;      //Matches player TWO won
+	long score1;
+	long score2;
+	long ticks;
+	long rallyTicks; //Sum of the rally lengths of all points
+	long levelTotal; //Sum of the levels reached at all points
+	int maxLevel;
+	long capped;     //Matches stopped at the tick limit before all their points
+};
+
+//Plays matches matches of pointsPerMatch points each (or
+//pointsPerMatch * POINT_TICK_LIMIT ticks, whichever comes first) on threads worker
+//threads (0 for one per core), with idle paddles and params (the defaults
+//if null).  Match i is seeded with matchSeed(seed, i), so the totals do not
+//depend on the number of threads or on which worker ended up playing which
+//match.
+RunStats runMatches(long matches, int pointsPerMatch, int threads, unsigned int seed,
+	const GameParams* params = 0);
+
+#endif
@@ -0,0 +1,676 @@
+//Headless match runner.  Plays matches without a window, as fast as the CPU
+//allows, and reports how many ticks per second that came to.
+//	g++ -O2 -mavx2 -std=c++11 -pthread -o dxball_sim sim.cpp game.cpp batch.cpp runner.cpp inputlog.cpp bot.cpp multiball.cpp level.cpp mappedfile.cpp netplay.cpp spectate.cpp matchserver.cpp
+//	dxball_sim [ticks]                          one match, one tick at a time
+//	dxball_sim events [ticks]                   one match, from event to event
+//	dxball_sim batch <ticks> <matches>          matches side by side in a MatchBatch
+//	dxball_sim run <matches> [threads] [points] whole matches on all cores
+//	dxball_sim serve <matches> [threads] [seconds]
+//	                                            matches between bots, all at
+//	                                            40 ticks a second, and how late
+//	                                            their ticks ran
+//	dxball_sim replay <log> [level file]        a recorded session (session.dxin),
+//	                                            on the stages it was played on
+//	dxball_sim bots [ticks]                     one match between two bots
+//	dxball_sim balls <count> [ticks]            one match with count extra balls
+//	dxball_sim level <file> [ticks]             one match on the stages in file,
+//	                                            which is first written with the
+//	                                            game's own if it does not exist
+//	dxball_sim net <bottom|top> <port> <host:port> [ticks [delay ms [loss % [jitter ms]]]]
+//	                                            a bot playing one side of a
+//	                                            netplay match in real time, e.g.
+//	                                            dxball_sim net bottom 7001 127.0.0.1:7002 800 100 5 &
+//	                                            dxball_sim net top 7002 127.0.0.1:7001 800 100 5
+//	                                            Both print the same final hash.
+//	dxball_sim spectate <port> [ticks]          a match between two bots in real
+//	                                            time, sent to every spectator
+//	                                            that connects (Linux)
+//	dxball_sim watch <host:port> <spectators> [seconds]
+//	                                            that many spectators of it
+//	                                            (Linux)
+//	dxball_sim spectate-check                   feeds a spectator bad message
+//	                                            lengths and checks it hangs up
+//	                                            (Linux)
+//Add -DFIXED_POINT for the fixed-point rules (see fixed.h).  A log replays
+//only in a build with the same setting as the game that recorded it.
+#include<iostream>
+#include <stdlib.h>
+#include <time.h>
+#include <stdio.h>
+#include "game.h"
+#include "batch.h"
+#include "runner.h"
+#include "inputlog.h"
+#include "bot.h"
+#include "multiball.h"
+#include "level.h"
+#include "netplay.h"
+#include "spectate.h"
+#include "matchserver.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+using namespace std;
+
+//Runs ticks ticks of every match in a batch
+void runBatch(long ticks, int matches)
+{
+	MatchBatch batch(matches, (unsigned int)time(NULL));
+	clock_t begin = clock();
+	for (long i = 0; i < ticks; i++)
+		batch.step();
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	long score1 = 0, score2 = 0, rallies = 0, levels = 0;
+	for (int i = 0; i < batch.size(); i++) {
+		score1 += batch.score1[i];
+		score2 += batch.score2[i];
+		rallies += batch.rallyTotal[i];
+		levels += batch.levelTotal[i];
+	}
+	long points = score1 + score2;
+	double total = (double)ticks * matches;
+	cout << "Ticks: " << total << " in " << seconds << " s ("
+		<< (seconds > 0 ? total / seconds : 0) << " ticks/s, "
+		<< MatchBatch::LANES << " lanes)\n";
+	cout << "Player ONE :" << score1 << " -- Player TWO : " << score2 << "\n";
+	cout << "Points: " << points << ", average level " << (points > 0 ? (double)levels / points : 0)
+		<< ", average rally " << (points > 0 ? (double)rallies / points : 0) << " ticks\n";
+}
+
+//Plays whole matches on all cores
+void runParallel(long matches, int threads, int points)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	RunStats stats = runMatches(matches, points, threads, (unsigned int)time(NULL));
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	long played = stats.score1 + stats.score2;
+	cout << "Matches: " << stats.matches << " of " << points << " points in " << seconds << " s ("
+		<< (seconds > 0 ? stats.ticks / seconds : 0) << " ticks/s)\n";
+	cout << "Player ONE :" << stats.score1 << " (" << stats.wins1 << " wins) -- Player TWO : "
+		<< stats.score2 << " (" << stats.wins2 << " wins)\n";
+	cout << "Average rally " << (played > 0 ? (double)stats.rallyTicks / played : 0)
+		<< " ticks, average level " << (played > 0 ? (double)stats.levelTotal / played : 0)
+		<< ", highest level " << stats.maxLevel << "\n";
+	if (stats.capped > 0)
+		cout << stats.capped << " matches stopped at " << POINT_TICK_LIMIT << " ticks a point\n";
+}
+
+//Hosts matches bot matches in real time for seconds, then reports how late
+//their ticks ran, over all ticks and match by match
+void runServe(int matches, int threads, double seconds)
+{
+	MatchServer server(matches, (unsigned int)time(NULL), 0, true);
+	clock_t cpuBegin = clock();
+	server.start(threads);
+	long last = 0;
+	for (int i = 1; i <= (int)seconds; i++) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		long ticks = server.ticks();
+		cout << ticks - last << " ticks/s (" << matches * 1000 / MatchServer::PERIOD_MS << " due)\n";
+		last = ticks;
+	}
+	server.stop();
+	double cpu = (double)(clock() - cpuBegin) / CLOCKS_PER_SEC;
+
+	vector<double> means, maxes;
+	long ticks = 0, late = 0, lateMatches = 0;
+	double lagSum = 0;
+	for (int i = 0; i < matches; i++) {
+		MatchLag lag = server.lag(i);
+		means.push_back(lag.meanMs);
+		maxes.push_back(lag.maxMs);
+		ticks += lag.ticks;
+		late += lag.late;
+		lagSum += lag.meanMs * lag.ticks;
+		if (lag.late > 0)
+			lateMatches++;
+	}
+	sort(means.begin(), means.end());
+	sort(maxes.begin(), maxes.end());
+	cout << matches << " matches, " << ticks << " ticks, CPU " << (ticks > 0 ? cpu * 1e6 / ticks : 0)
+		<< " us a tick; mean lag " << (ticks > 0 ? lagSum / ticks : 0) << " ms\n";
+	cout << "Mean lag by match, ms: p50 " << means[matches / 2] << "  p99 " << means[matches * 99 / 100]
+		<< "  max " << means.back() << "\n";
+	cout << "Worst lag by match, ms: p50 " << maxes[matches / 2] << "  p99 " << maxes[matches * 99 / 100]
+		<< "  max " << maxes.back() << "\n";
+	cout << late << " ticks a period or more late, in " << lateMatches << " matches\n";
+}
+
+//Plays one match for ticks ticks, either one tick at a time or jumping from
+//event to event
+void runSingle(long ticks, bool events)
+{
+	GameState game;
+	long points = 0;
+	long levels = 0;
+	long steps = 0;
+
+	clock_t begin = clock();
+	while (game.tick < ticks) {
+		PointRecord point;
+		bool scored;
+		if (game.pause != 0) {
+			Inputs inputs;
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+			scored = step(game, inputs, &point);
+		}
+		else if (events)
+			scored = stepToEvent(game, ticks - game.tick, &point);
+		else scored = step(game, Inputs(), &point);
+		steps++;
+		if (scored) {
+			points++;
+			levels += point.level;
+		}
+	}
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	cout << "Ticks: " << ticks << " in " << seconds << " s ("
+		<< (seconds > 0 ? ticks / seconds : 0) << " ticks/s)\n";
+	cout << "Player ONE :" << game.score1 << " -- Player TWO : " << game.score2 << "\n";
+	cout << "Points: " << points << ", average level " << (points > 0 ? (double)levels / points : 0)
+		<< ", " << (points > 0 ? (double)steps / points : 0) << " steps per point\n";
+}
+
+//Plays one match on the stages in filename, writing the game's own there
+//first if there is no such file
+int runLevel(const char* filename, long ticks)
+{
+	Level level;
+	if (!level.load(filename)) {
+		FILE* existing = fopen(filename, "rb");
+		if (existing != NULL) {
+			fclose(existing);
+			cerr << "Not a level this build can read: " << filename << "\n";
+			return 1;
+		}
+		if (!Level::builtIn().save(filename) || !level.load(filename)) {
+			cerr << "Could not write level " << filename << "\n";
+			return 1;
+		}
+		cout << "Wrote the game's own stages to " << filename << "\n";
+	}
+	cout << "Level: " << level.stageCount() << " stages, " << level.header().obstacleCount << " obstacles, "
+		<< level.header().size << " bytes\n";
+
+	GameParams params;
+	params.level = &level;
+	GameState game(1, &params);
+	long points = 0;
+	clock_t begin = clock();
+	while (game.tick < ticks) {
+		Inputs inputs;
+		if (game.pause != 0)
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+		if (step(game, inputs))
+			points++;
+	}
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	cout << "Ticks: " << ticks << " in " << seconds << " s ("
+		<< (seconds > 0 ? ticks / seconds : 0) << " ticks/s)\n";
+	cout << "Player ONE :" << game.score1 << " -- Player TWO : " << game.score2 << " (" << points << " points)\n";
+	return 0;
+}
+
+//CPU time this thread has used, in microseconds.  Elsewhere than Linux,
+//wall-clock time, which also counts time the thread was switched out.
+double threadMicros()
+{
+#ifdef __linux__
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#else
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//Plays one match between two bots and times their decisions: each as it
+//was made, on the thread's CPU clock.  A decision over the 50 us budget is
+//made again on a copy of the inputs (the bot only reads the state); if
+//that one is within budget the first was held up by something else, an
+//interrupt or a page fault, and it is counted apart.  The times reported
+//are still the first ones.
+void runBots(long ticks)
+{
+	GameState game;
+	long points = 0;
+	long rallies = 0;
+	long rallyStart = 0;
+	vector<double> decisions;
+	decisions.reserve(2 * ticks);
+	long slow = 0;   //Decisions over the 50 us budget
+	long stalled = 0; //Of those, within it when made again
+
+	clock_t begin = clock();
+	while (game.tick < ticks) {
+		Inputs inputs;
+		if (game.pause != 0)
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+		for (int side = SIDE_BOTTOM; side <= SIDE_TOP; side++) {
+			double start = threadMicros();
+			botInputs(game, (Side)side, inputs);
+			double us = threadMicros() - start;
+			decisions.push_back(us);
+			if (us > 50) {
+				slow++;
+				Inputs scratch;
+				start = threadMicros();
+				botInputs(game, (Side)side, scratch);
+				if (threadMicros() - start <= 50)
+					stalled++;
+			}
+		}
+		if (step(game, inputs)) {
+			points++;
+			rallies += game.tick - rallyStart;
+			rallyStart = game.tick;
+		}
+	}
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	cout << "Ticks: " << ticks << " in " << seconds << " s ("
+		<< (seconds > 0 ? ticks / seconds : 0) << " ticks/s)\n";
+	cout << "Player ONE :" << game.score1 << " -- Player TWO : " << game.score2 << "\n";
+	cout << "Points: " << points << ", average rally " << (points > 0 ? (double)rallies / points : 0)
+		<< " ticks\n";
+	if (decisions.empty())
+		return;
+	double total = 0;
+	for (size_t i = 0; i < decisions.size(); i++)
+		total += decisions[i];
+	sort(decisions.begin(), decisions.end());
+	size_t n = decisions.size();
+	cout << "Bot decisions: " << total / n << " us average, " << decisions[n * 99 / 100] << " us 99th percentile, "
+		<< decisions[n * 999 / 1000] << " us 99.9th, " << decisions[n - 1] << " us slowest\n";
+	cout << "  " << slow << " over 50 us; " << stalled << " of them within it when made again, "
+		<< slow - stalled << " not\n";
+}
+
+//Plays one match with count extra balls and times their ticks
+void runBalls(int count, long ticks)
+{
+	GameState game;
+	MultiBall balls(count, 1);
+	double slowest = 0;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	while (game.tick < ticks) {
+		Inputs inputs;
+		if (game.pause != 0)
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+		step(game, inputs);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		balls.step(game);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (ms > slowest)
+			slowest = ms;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	cout << "Ticks: " << ticks << " with " << count << " balls in " << seconds << " s ("
+		<< (seconds > 0 ? ticks / seconds : 0) << " ticks/s, " << (ticks > 0 ? seconds * 1000 / ticks : 0)
+		<< " ms average, " << slowest << " ms slowest)\n";
+	cout << "Player ONE :" << balls.score1 << " -- Player TWO : " << balls.score2 << " with the extra balls, "
+		<< balls.contacts << " ball to ball contacts\n";
+}
+
+//Plays side of a netplay match with a bot at 40 ticks a second, then waits
+//for both sides to have every input up to ticks
+int runNet(Side side, int port, const char* peer, long ticks, const NetConditions &conditions)
+{
+	GameParams params;
+	Netplay net;
+	if (!net.open(side, port, peer, (unsigned int)time(NULL), &params)) {
+		cerr << "Could not open port " << port << " for " << peer << "\n";
+		return 1;
+	}
+	net.conditions = conditions;
+	long points = 0;
+	double slowest = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point next = begin;
+	std::chrono::steady_clock::time_point lastTick = begin;
+	while (net.state().tick < ticks && net.error == NULL) {
+		net.poll();
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - lastTick > std::chrono::seconds(10)) {
+			cerr << "Nothing from " << peer << " for 10 s\n";
+			return 1;
+		}
+		if (now < next) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		next += std::chrono::milliseconds(25);
+		Inputs moves;
+		if (side == SIDE_BOTTOM && net.state().pause != 0)
+			moves.push(INPUT_PAUSE); //Serve straight away after a point
+		botInputs(net.state(), side, moves);
+		for (int i = 0; i < moves.count; i++)
+			net.addLocal((InputType)moves.types[i]);
+		if (net.tick())
+			lastTick = now;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - now).count();
+		if (ms > slowest)
+			slowest = ms;
+		for (size_t i = 0; i < net.confirmedTicks.size(); i++)
+			points += net.confirmedTicks[i].scored;
+		net.confirmedTicks.clear();
+	}
+	//The other side may still need inputs resent, or our acknowledgement
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point settled = end;
+	while (net.error == NULL && std::chrono::steady_clock::now() - end < std::chrono::seconds(5) &&
+		(!net.settled(ticks) || std::chrono::steady_clock::now() - settled < std::chrono::milliseconds(500))) {
+		if (!net.settled(ticks))
+			settled = std::chrono::steady_clock::now();
+		net.poll();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	for (size_t i = 0; i < net.confirmedTicks.size(); i++)
+		points += net.confirmedTicks[i].scored;
+	if (net.error != NULL) {
+		cerr << "Netplay stopped: " << net.error << "\n";
+		return 1;
+	}
+
+	const NetStats &s = net.stats;
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	cout << (side == SIDE_BOTTOM ? "Bottom" : "Top") << ": " << net.state().tick << " ticks in " << seconds
+		<< " s, seed " << net.seed() << ", " << points << " points confirmed\n";
+	cout << "Predicted " << s.predicted << " ticks; " << s.rollbacks << " rollbacks replayed " << s.resimulated
+		<< " ticks, at most " << s.deepest << " at once; slowest tick " << slowest << " ms\n";
+	cout << "Waited " << s.stalls << " ticks for the other side, " << s.syncWaits << " to keep in step\n";
+	cout << "Packets: " << s.sent << " sent, " << s.dropped << " dropped, " << s.received << " received, "
+		<< s.rejected << " rejected\n";
+	if (!net.settled(ticks)) {
+		cout << "Did not hear the other side's last inputs; confirmed up to tick " << net.confirmedState().tick << "\n";
+		return 2;
+	}
+	cout << "Final hash " << hex << stateHash(net.confirmedState()) << dec
+		<< (stateHash(net.state()) == stateHash(net.confirmedState()) ? "" : " (PREDICTED STATE DIFFERS)") << ", "
+		<< s.desyncs << " desyncs\n";
+	return s.desyncs != 0 || stateHash(net.state()) != stateHash(net.confirmedState()) ? 2 : 0;
+}
+
+//Plays a match between two bots at 40 ticks a second for spectators,
+//reporting what each costs every 10 s
+int runSpectate(int port, long ticks)
+{
+	SpectatorServer server;
+	if (!server.listen(port)) {
+		cerr << "Could not listen on port " << port << "\n";
+		return 1;
+	}
+	GameState game;
+	SpectateStats last;
+	long watched = 0; //Sum over ticks of the spectators then
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while (game.tick < ticks) {
+		int wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count();
+		server.poll(wait > 0 ? wait : 0);
+		if (std::chrono::steady_clock::now() < next)
+			continue;
+		next += std::chrono::milliseconds(25);
+		Inputs inputs;
+		if (game.pause != 0)
+			inputs.push(INPUT_PAUSE); //Serve straight away after a point
+		botInputs(game, SIDE_BOTTOM, inputs);
+		botInputs(game, SIDE_TOP, inputs);
+		step(game, inputs);
+		server.publish(game);
+		watched += server.spectators();
+
+		if (game.tick % 400 == 0 || game.tick == ticks) {
+			const SpectateStats &s = server.stats;
+			long sent = s.sent - last.sent;
+			double cpu = s.publishMs + s.pollMs - last.publishMs - last.pollMs;
+			double seconds = (s.ticks - last.ticks) / 40.0;
+			double spectators = (double)watched / (s.ticks - last.ticks);
+			cout << "Tick " << game.tick << ": " << server.spectators() << " spectators, "
+				<< (seconds > 0 ? (s.bytes - last.bytes) / seconds : 0) / 1024 << " KB/s in all, "
+				<< (sent > 0 ? (double)(s.bytes - last.bytes) / sent : 0) << " bytes a message, "
+				<< (spectators > 0 ? (s.bytes - last.bytes) / seconds / spectators : 0) << " bytes/s each\n";
+			cout << "  CPU " << cpu / (s.ticks - last.ticks) << " ms a tick, "
+				<< (sent > 0 ? cpu * 1000 / sent : 0) << " us a message; "
+				<< s.keyframes - last.keyframes << " keyframes, " << s.skipped - last.skipped << " skipped, "
+				<< (double)(s.encodes - last.encodes) / (s.ticks - last.ticks) << " encodes a tick\n";
+			last = s;
+			watched = 0;
+		}
+	}
+	return 0;
+}
+
+#ifdef __linux__
+
+//Opens spectators connections to a spectate server and follows the match
+//on each for seconds
+int runWatch(const char* address, int spectators, double seconds)
+{
+	vector<SpectatorClient*> clients;
+	int epoll = epoll_create1(0);
+	for (int i = 0; i < spectators; i++) {
+		SpectatorClient* c = new SpectatorClient;
+		if (!c->connect(address)) {
+			cerr << "Connected " << i << " spectators; could not connect more to " << address << "\n";
+			delete c;
+			break;
+		}
+		epoll_event e;
+		e.events = EPOLLIN;
+		e.data.ptr = c;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, c->socket(), &e);
+		clients.push_back(c);
+	}
+	clock_t cpuBegin = clock();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	while (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < seconds) {
+		epoll_event events[256];
+		int ready = epoll_wait(epoll, events, 256, 100);
+		for (int i = 0; i < ready; i++) {
+			SpectatorClient* c = (SpectatorClient*)events[i].data.ptr;
+			if (c->socket() >= 0 && !c->receive())
+				epoll_ctl(epoll, EPOLL_CTL_DEL, c->socket(), NULL);
+		}
+	}
+	double cpu = (double)(clock() - cpuBegin) / CLOCKS_PER_SEC;
+
+	long messages = 0, keyframes = 0, bytes = 0, broken = 0, behind = 0, newest = -1;
+	for (size_t i = 0; i < clients.size(); i++) {
+		if (clients[i]->tick > newest)
+			newest = clients[i]->tick;
+	}
+	for (size_t i = 0; i < clients.size(); i++) {
+		SpectatorClient* c = clients[i];
+		messages += c->messages;
+		keyframes += c->keyframes;
+		bytes += c->bytes;
+		broken += c->broken;
+		if (c->tick < newest - 1)
+			behind++;
+		delete c;
+	}
+	close(epoll);
+	double n = clients.size() > 0 ? (double)clients.size() : 1;
+	cout << clients.size() << " spectators for " << seconds << " s: " << messages / n / seconds
+		<< " snapshots/s and " << bytes / n / seconds << " bytes/s each, " << keyframes << " keyframes, "
+		<< broken << " broken, " << behind << " more than a tick behind at the end\n";
+	cout << "Client CPU " << (messages > 0 ? cpu * 1e6 / messages : 0) << " us a snapshot\n";
+	return broken != 0 ? 2 : 0;
+}
+
+//Sends a spectator a message whose length byte is length, the rest of it
+//after a pause so the client has to hold the length byte on its own first.
+//True if the client hung up on it and counted it as broken.
+bool checkSpectateLength(int length)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t size = sizeof(address);
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+		::listen(listener, 1) != 0 || getsockname(listener, (sockaddr*)&address, &size) != 0) {
+		cerr << "Could not listen on the loopback interface\n";
+		if (listener >= 0)
+			close(listener);
+		return false;
+	}
+	char name[32];
+	sprintf(name, "127.0.0.1:%d", ntohs(address.sin_port));
+	SpectatorClient client;
+	int server = client.connect(name) ? accept(listener, NULL, NULL) : -1;
+	close(listener);
+	if (server < 0) {
+		cerr << "Could not connect to " << name << "\n";
+		return false;
+	}
+
+	unsigned char message[256];
+	memset(message, 0xee, sizeof(message));
+	message[0] = (unsigned char)length;
+	bool open = true;
+	for (int part = 0; part < 2 && open; part++) {
+		if (part == 0)
+			send(server, message, 1, MSG_NOSIGNAL);
+		else send(server, message + 1, length, MSG_NOSIGNAL);
+		//Until the client has seen it; the server end stays open, so a
+		//false is the client hanging up
+		for (int wait = 0; wait < 100 && open; wait++) {
+			open = client.receive();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	close(server);
+	bool passed = !open && client.broken == 1 && client.tick == -1;
+	cout << "Length byte " << length << ": " << (open ? "still connected" : "hung up") << ", "
+		<< client.broken << " broken -- " << (passed ? "ok" : "FAILED") << "\n";
+	return passed;
+}
+
+//Checks a spectator refuses every length byte no message can have, the
+//longest of which would not fit its buffer
+int runSpectateCheck()
+{
+	bool passed = true;
+	int lengths[] = { 0, 8, SPECTATE_MESSAGE, 255 };
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+		passed = checkSpectateLength(lengths[i]) && passed;
+	return passed ? 0 : 2;
+}
+
+#endif
+
+//Replays a session recorded by the game and checks it ends where the game did
+int runReplay(const char* filename, const char* levelFile)
+{
+	InputLog log;
+	if (!log.load(filename)) {
+		cerr << "Could not read input log " << filename << "\n";
+		return 1;
+	}
+	Level level;
+	GameParams params;
+	if (levelFile != NULL) {
+		if (!level.load(levelFile)) {
+			cerr << "Could not read level " << levelFile << "\n";
+			return 1;
+		}
+		params.level = &level;
+	}
+	GameState game;
+	clock_t begin = clock();
+	long points = replay(log, game, &params);
+	if (points < 0) {
+		cerr << filename << " was played by other rules: other stages, balance numbers or a "
+			<< "fixed-point build where this is not, or the other way round\n";
+		if (levelFile == NULL)
+			cerr << "If it was played with -level, give the same level file\n";
+		return 2;
+	}
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	cout << "Replayed " << log.inputs.size() << " inputs over " << game.tick << " ticks in "
+		<< seconds << " s (" << (seconds > 0 ? game.tick / seconds : 0) << " ticks/s)\n";
+	cout << "Player ONE :" << game.score1 << " -- Player TWO : " << game.score2
+		<< " (" << points << " points)\n";
+	if (!log.complete) {
+		cout << "Log was not closed; replayed up to its last input\n";
+		return 0;
+	}
+	if (stateHash(game) != log.endHash) {
+		cout << "MISMATCH: final state differs from the recorded session\n";
+		return 2;
+	}
+	cout << "Final state matches the recorded session\n";
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "replay") == 0)
+		return runReplay(argv[2], argc > 3 ? argv[3] : NULL);
+	if (argc > 1 && strcmp(argv[1], "bots") == 0) {
+		runBots(argc > 2 ? atol(argv[2]) : 1000000);
+		return 0;
+	}
+	if (argc > 4 && strcmp(argv[1], "net") == 0) {
+		NetConditions conditions;
+		conditions.delayMs = argc > 6 ? atof(argv[6]) : 0;
+		conditions.lossPercent = argc > 7 ? atof(argv[7]) : 0;
+		conditions.jitterMs = argc > 8 ? atof(argv[8]) : 0;
+		return runNet(strcmp(argv[2], "top") == 0 ? SIDE_TOP : SIDE_BOTTOM, atoi(argv[3]), argv[4],
+			argc > 5 ? atol(argv[5]) : 2400, conditions);
+	}
+	if (argc > 2 && strcmp(argv[1], "spectate") == 0)
+		return runSpectate(atoi(argv[2]), argc > 3 ? atol(argv[3]) : 2400);
+#ifdef __linux__
+	if (argc > 1 && strcmp(argv[1], "spectate-check") == 0)
+		return runSpectateCheck();
+	if (argc > 3 && strcmp(argv[1], "watch") == 0)
+		return runWatch(argv[2], atoi(argv[3]), argc > 4 ? atof(argv[4]) : 10);
+#endif
+	if (argc > 2 && strcmp(argv[1], "level") == 0)
+		return runLevel(argv[2], argc > 3 ? atol(argv[3]) : 1000000);
+	if (argc > 2 && strcmp(argv[1], "balls") == 0) {
+		if (atoi(argv[2]) < 0) {
+			cerr << "Need 0 or more balls, not " << argv[2] << "\n";
+			return 1;
+		}
+		runBalls(atoi(argv[2]), argc > 3 ? atol(argv[3]) : 10000);
+		return 0;
+	}
+	if (argc > 3 && strcmp(argv[1], "batch") == 0) {
+		runBatch(atol(argv[2]), atoi(argv[3]));
+		return 0;
+	}
+	if (argc > 2 && strcmp(argv[1], "run") == 0) {
+		runParallel(atol(argv[2]), argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 10);
+		return 0;
+	}
+	if (argc > 2 && strcmp(argv[1], "serve") == 0 && atoi(argv[2]) > 0) {
+		runServe(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atof(argv[4]) : 10);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "events") == 0) {
+		runSingle(argc > 2 ? atol(argv[2]) : 10000000, true);
+		return 0;
+	}
+	runSingle(argc > 1 ? atol(argv[1]) : 10000000, false);
+	return 0;
+}
@@ -0,0 +1,518 @@
+#include "spectate.h"
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	unsigned short fixed3(double value) {
+		return (unsigned short)(short)lround(value * 1000);
+	}
+
+	double unfixed3(unsigned short field) {
+		return (short)field / 1000.0;
+	}
+
+	unsigned short degrees(float angle) {
+		double a = fmod(angle, 360);
+		return (unsigned short)lround((a < 0 ? a + 360 : a) * 100);
+	}
+
+	void put16(unsigned char* p, unsigned int value) {
+		p[0] = (unsigned char)value;
+		p[1] = (unsigned char)(value >> 8);
+	}
+
+	void put32(unsigned char* p, unsigned int value) {
+		put16(p, value);
+		put16(p + 2, value >> 16);
+	}
+
+	unsigned int get16(const unsigned char* p) {
+		return p[0] | (p[1] << 8);
+	}
+
+	unsigned int get32(const unsigned char* p) {
+		return get16(p) | (get16(p + 2) << 16);
+	}
+
+#ifdef __linux__
+	//CPU time of the calling thread, in ms
+	double threadMs() {
+		timespec t;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+		return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+	}
+#endif
+}
+
+Snapshot::Snapshot() {
+	memset(field, 0, sizeof(field));
+}
+
+Snapshot::Snapshot(const GameState &s) {
+	field[BALL_X] = fixed3(toDouble(s.ballx));
+	field[BALL_Y] = fixed3(toDouble(s.bally));
+	field[X_SPEED] = fixed3(toDouble(s.xspeed));
+	field[Y_SPEED] = fixed3(toDouble(s.yspeed));
+	field[X_BOTTOM] = fixed3(toDouble(s.xbot));
+	field[X_TOP] = fixed3(toDouble(s.xtop));
+	field[TILT_BOTTOM] = (unsigned short)s.kupdown;
+	field[TILT_TOP] = (unsigned short)s.mupdown;
+	field[FAN_ANGLE] = degrees(s._angle);
+	field[BARRIER_ANGLE] = degrees(s._ang_tri);
+	field[SCORE1] = (unsigned short)s.score1;
+	field[SCORE2] = (unsigned short)s.score2;
+	field[STAGE] = (unsigned short)s.stage;
+	field[LEVEL] = (unsigned short)s.level;
+	field[PAUSE] = (unsigned short)s.pause;
+}
+
+void Snapshot::apply(GameState &s) const {
+	s.ballx = unfixed3(field[BALL_X]);
+	s.bally = unfixed3(field[BALL_Y]);
+	s.prevx = s.ballx;
+	s.prevy = s.bally;
+	s.xspeed = unfixed3(field[X_SPEED]);
+	s.yspeed = unfixed3(field[Y_SPEED]);
+	s.xbot = unfixed3(field[X_BOTTOM]);
+	s.xtop = unfixed3(field[X_TOP]);
+	s.kupdown = (short)field[TILT_BOTTOM];
+	s.mupdown = (short)field[TILT_TOP];
+	s._angle = field[FAN_ANGLE] / 100.f;
+	s._ang_tri = field[BARRIER_ANGLE] / 100.f;
+	s.score1 = field[SCORE1];
+	s.score2 = field[SCORE2];
+	s.stage = field[STAGE];
+	s.level = field[LEVEL];
+	s.pause = field[PAUSE];
+}
+
+unsigned short Snapshot::checksum() const {
+	//Fletcher-16
+	unsigned int a = 0, b = 0;
+	for (int i = 0; i < FIELDS; i++) {
+		a = (a + (field[i] & 0xff) + (field[i] >> 8)) % 255;
+		b = (b + a) % 255;
+	}
+	return (unsigned short)(b << 8 | a);
+}
+
+SpectateStats::SpectateStats() : ticks(0), sent(0), keyframes(0), skipped(0), bytes(0), encodes(0),
+	accepted(0), closed(0), publishMs(0), pollMs(0) {
+
+}
+
+SpectatorServer::SpectatorServer() : listener(-1), epoll(-1), count(0) {
+	for (int i = 0; i < SPECTATE_HISTORY; i++) {
+		historyTick[i] = -1;
+		encodedTick[i] = -1;
+	}
+}
+
+SpectatorServer::~SpectatorServer() {
+	close();
+}
+
+#ifdef __linux__
+
+bool SpectatorServer::listen(int port) {
+	close();
+	listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listener < 0)
+		return false;
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((unsigned short)port);
+	epoll = epoll_create1(0);
+	epoll_event e;
+	e.events = EPOLLIN;
+	e.data.u32 = 0xffffffffu; //The listener
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0 ||
+		epoll < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &e) != 0) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void SpectatorServer::close() {
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].fd >= 0)
+			::close(slots[i].fd);
+	}
+	slots.clear();
+	freeSlots.clear();
+	count = 0;
+	if (listener >= 0)
+		::close(listener);
+	if (epoll >= 0)
+		::close(epoll);
+	listener = -1;
+	epoll = -1;
+}
+
+void SpectatorServer::accept() {
+	for (;;) {
+		int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+		if (fd < 0)
+			return;
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		int slot;
+		if (freeSlots.empty()) {
+			slot = (int)slots.size();
+			slots.push_back(Spectator());
+		}
+		else {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		Spectator &s = slots[slot];
+		s.fd = fd;
+		s.acked = -1;
+		s.ackSize = 0;
+		s.unsent.clear();
+		epoll_event e;
+		e.events = EPOLLIN;
+		e.data.u32 = (unsigned int)slot;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &e);
+		count++;
+		stats.accepted++;
+	}
+}
+
+void SpectatorServer::drop(int slot) {
+	Spectator &s = slots[slot];
+	::close(s.fd); //Also takes it out of the epoll set
+	s.fd = -1;
+	s.unsent.clear();
+	freeSlots.push_back(slot);
+	count--;
+	stats.closed++;
+}
+
+//Reads acknowledgements; only the newest matters
+void SpectatorServer::read(Spectator &s) {
+	unsigned char buffer[256];
+	ssize_t size = recv(s.fd, buffer, sizeof(buffer), 0);
+	if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		drop((int)(&s - &slots[0]));
+		return;
+	}
+	for (ssize_t i = 0; i < size; i++) {
+		s.ack[s.ackSize++] = buffer[i];
+		if (s.ackSize == 4) {
+			unsigned int tick = get32(s.ack);
+			s.acked = tick == SPECTATE_NO_TICK ? -1 : (long)tick;
+			s.ackSize = 0;
+		}
+	}
+}
+
+//Sends what is left of a message; stops waiting for room once it is gone
+void SpectatorServer::flush(Spectator &s, int slot) {
+	ssize_t size = send(s.fd, &s.unsent[0], s.unsent.size(), MSG_NOSIGNAL);
+	if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		drop(slot);
+		return;
+	}
+	if (size > 0) {
+		stats.bytes += size;
+		s.unsent.erase(s.unsent.begin(), s.unsent.begin() + size);
+	}
+	if (s.unsent.empty()) {
+		epoll_event e;
+		e.events = EPOLLIN;
+		e.data.u32 = (unsigned int)slot;
+		epoll_ctl(epoll, EPOLL_CTL_MOD, s.fd, &e);
+	}
+}
+
+void SpectatorServer::poll(int timeoutMs) {
+	if (epoll < 0)
+		return;
+	double start = threadMs();
+	epoll_event events[256];
+	int ready = epoll_wait(epoll, events, 256, timeoutMs);
+	for (int i = 0; i < ready; i++) {
+		unsigned int slot = events[i].data.u32;
+		if (slot == 0xffffffffu) {
+			accept();
+			continue;
+		}
+		if (slot >= slots.size() || slots[slot].fd < 0)
+			continue; //Dropped earlier in this batch
+		Spectator &s = slots[slot];
+		if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+			drop((int)slot);
+			continue;
+		}
+		if (events[i].events & EPOLLIN)
+			read(s);
+		if (s.fd >= 0 && (events[i].events & EPOLLOUT) && !s.unsent.empty())
+			flush(s, (int)slot);
+	}
+	stats.pollMs += threadMs() - start;
+}
+
+#else
+
+bool SpectatorServer::listen(int) {
+	return false;
+}
+
+void SpectatorServer::close() {
+}
+
+void SpectatorServer::poll(int) {
+}
+
+#endif
+
+//The message for tick against the snapshot back ticks before it (0 for
+//none), encoded the first time a spectator needs it this tick
+const unsigned char* SpectatorServer::message(long tick, long back) {
+	unsigned char* m = encoded[back];
+	if (encodedTick[back] == tick)
+		return m;
+	encodedTick[back] = tick;
+	stats.encodes++;
+	const Snapshot &now = history[tick % SPECTATE_HISTORY];
+	const Snapshot* base = back > 0 ? &history[(tick - back) % SPECTATE_HISTORY] : NULL;
+	unsigned int mask = 0;
+	int size = 10;
+	for (int i = 0; i < Snapshot::FIELDS; i++) {
+		if (base == NULL || base->field[i] != now.field[i]) {
+			mask |= 1 << i;
+			put16(m + size, now.field[i]);
+			size += 2;
+		}
+	}
+	m[0] = (unsigned char)(size - 1);
+	put32(m + 1, (unsigned int)tick);
+	m[5] = (unsigned char)back;
+	put16(m + 6, mask);
+	put16(m + 8, now.checksum());
+	return m;
+}
+
+void SpectatorServer::publish(const GameState &state) {
+#ifdef __linux__
+	if (epoll < 0)
+		return;
+	double start = threadMs();
+	long tick = state.tick;
+	history[tick % SPECTATE_HISTORY] = Snapshot(state);
+	historyTick[tick % SPECTATE_HISTORY] = tick;
+	stats.ticks++;
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		Spectator &s = slots[i];
+		if (s.fd < 0)
+			continue;
+		if (!s.unsent.empty()) {
+			stats.skipped++;
+			continue;
+		}
+		long back = tick - s.acked;
+		if (s.acked < 0 || back <= 0 || back >= SPECTATE_HISTORY ||
+			historyTick[s.acked % SPECTATE_HISTORY] != s.acked)
+			back = 0;
+		const unsigned char* m = message(tick, back);
+		int size = m[0] + 1;
+		ssize_t sent = send(s.fd, m, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			drop((int)i);
+			continue;
+		}
+		stats.sent++;
+		if (back == 0)
+			stats.keyframes++;
+		if (sent > 0)
+			stats.bytes += sent;
+		if (sent < size) {
+			//Finished when the socket has room; until then this spectator skips snapshots
+			s.unsent.assign(m + (sent > 0 ? sent : 0), m + size);
+			epoll_event e;
+			e.events = EPOLLIN | EPOLLOUT;
+			e.data.u32 = (unsigned int)i;
+			epoll_ctl(epoll, EPOLL_CTL_MOD, s.fd, &e);
+		}
+	}
+	stats.publishMs += threadMs() - start;
+#endif
+}
+
+SpectatorClient::SpectatorClient() : tick(-1), messages(0), keyframes(0), bytes(0), broken(0), sock(-1),
+	partialSize(0), resync(false) {
+	for (int i = 0; i < SPECTATE_HISTORY; i++)
+		historyTick[i] = -1;
+}
+
+SpectatorClient::~SpectatorClient() {
+	close();
+}
+
+#ifdef __linux__
+
+bool SpectatorClient::connect(const char* address) {
+	close();
+	std::string host(address);
+	size_t colon = host.rfind(':');
+	if (colon == std::string::npos)
+		return false;
+	std::string port = host.substr(colon + 1);
+	host.resize(colon);
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = NULL;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || found == NULL)
+		return false;
+	sock = ::socket(AF_INET, SOCK_STREAM, 0);
+	bool connected = sock >= 0 && ::connect(sock, found->ai_addr, found->ai_addrlen) == 0;
+	freeaddrinfo(found);
+	if (!connected) {
+		close();
+		return false;
+	}
+	int on = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	return true;
+}
+
+void SpectatorClient::close() {
+	if (sock >= 0)
+		::close(sock);
+	sock = -1;
+}
+
+bool SpectatorClient::receive() {
+	if (sock < 0)
+		return false;
+	long before = tick;
+	for (;;) {
+		unsigned char buffer[4096];
+		ssize_t size = recv(sock, buffer, sizeof(buffer), 0);
+		if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			close();
+			return false;
+		}
+		if (size < 0)
+			break;
+		bytes += size;
+		const unsigned char* p = buffer;
+		const unsigned char* end = buffer + size;
+		while (p < end) {
+			//Messages can be split anywhere between reads
+			int need = partialSize > 0 ? partial[0] + 1 : *p + 1;
+			if (need < 10 || need > SPECTATE_MESSAGE) {
+				//Not a length the server sends: where the next message
+				//starts is lost, so there is nothing to resync from
+				messages++;
+				broken++;
+				close();
+				return false;
+			}
+			int take = (int)(end - p) < need - partialSize ? (int)(end - p) : need - partialSize;
+			if (partialSize == 0 && take == need) {
+				apply(p, need);
+				p += need;
+				continue;
+			}
+			memcpy(partial + partialSize, p, take);
+			partialSize += take;
+			p += take;
+			if (partialSize == need) {
+				apply(partial, need);
+				partialSize = 0;
+			}
+		}
+	}
+	if (tick != before || resync) {
+		unsigned char ack[4];
+		put32(ack, resync ? SPECTATE_NO_TICK : (unsigned int)tick);
+		send(sock, ack, 4, MSG_NOSIGNAL);
+		resync = false;
+	}
+	return true;
+}
+
+#else
+
+bool SpectatorClient::connect(const char*) {
+	return false;
+}
+
+void SpectatorClient::close() {
+}
+
+bool SpectatorClient::receive() {
+	return false;
+}
+
+#endif
+
+void SpectatorClient::apply(const unsigned char* m, int size) {
+	messages++;
+	if (size < 10 || size > SPECTATE_MESSAGE) {
+		broken++;
+		resync = true;
+		return;
+	}
+	long at = (long)get32(m + 1);
+	int back = m[5];
+	unsigned int mask = get16(m + 6);
+	Snapshot s;
+	if (back > 0) {
+		long base = at - back;
+		if (back >= SPECTATE_HISTORY || base < 0 || historyTick[base % SPECTATE_HISTORY] != base) {
+			broken++;
+			resync = true;
+			return;
+		}
+		s = history[base % SPECTATE_HISTORY];
+	}
+	else keyframes++;
+	const unsigned char* p = m + 10;
+	for (int i = 0; i < Snapshot::FIELDS; i++) {
+		if (mask & (1 << i)) {
+			if (p + 2 > m + size) {
+				broken++;
+				resync = true;
+				return;
+			}
+			s.field[i] = (unsigned short)get16(p);
+			p += 2;
+		}
+	}
+	if (s.checksum() != get16(m + 8)) {
+		broken++;
+		resync = true;
+		return;
+	}
+	history[at % SPECTATE_HISTORY] = s;
+	historyTick[at % SPECTATE_HISTORY] = at;
+	latest = s;
+	tick = at;
+}
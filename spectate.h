@@ -0,0 +1,159 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+//Spectators: a match sent tick by tick to any number of viewers over TCP.
+//
+//Each tick the server takes a Snapshot of what a viewer draws and sends
+//every spectator only the fields that changed since the last snapshot that
+//spectator acknowledged.  Spectators can only be a few ticks behind, so
+//there are at most HISTORY different deltas a tick.  Each is encoded once
+//and the same bytes go to every spectator that needs them, which keeps the
+//work per tick apart from the sends flat however many are watching.  A
+//spectator too slow to take a snapshot skips it rather than holding up the
+//others, and catches up with a delta against what it did acknowledge.
+//
+//The server is one thread on epoll, so Linux only; elsewhere listen() and
+//connect() fail.  Needs C++11.
+#include "game.h"
+#include <vector>
+
+//What a spectator sees of the match, in 16 bit fields: positions and speeds
+//in thousandths of a unit, angles in hundredths of a degree
+struct Snapshot {
+	enum Field {
+		BALL_X, BALL_Y, X_SPEED, Y_SPEED, X_BOTTOM, X_TOP, TILT_BOTTOM, TILT_TOP,
+		FAN_ANGLE, BARRIER_ANGLE, SCORE1, SCORE2, STAGE, LEVEL, PAUSE,
+		FIELDS
+	};
+
+	Snapshot();
+	explicit Snapshot(const GameState &state);
+
+	//Sets what the snapshot holds on state, leaving the rest as it is
+	void apply(GameState &state) const;
+
+	unsigned short checksum() const;
+
+	unsigned short field[FIELDS];
+};
+
+//A message is a length byte, then the tick (32 bits), how many ticks back
+//its base is (0 for none, i.e. every field), a 16 bit mask of the fields
+//sent, the checksum of the whole snapshot and the fields sent, all little
+//endian.  A spectator answers with the 32 bit tick of the newest snapshot
+//it has, or NO_TICK to ask for every field again.
+const int SPECTATE_HISTORY = 32; //Ticks a delta can reach back
+const int SPECTATE_MESSAGE = 10 + 2 * Snapshot::FIELDS; //Longest message, length byte included
+const unsigned int SPECTATE_NO_TICK = 0xffffffffu;
+
+struct SpectateStats {
+	SpectateStats();
+
+	long ticks;       //Snapshots published
+	long sent;        //Messages
+	long keyframes;   //Of those, with every field
+	long skipped;     //Snapshots a spectator could not take yet
+	long bytes;
+	long encodes;     //Deltas encoded; at most HISTORY a tick
+	long accepted;    //Spectators connected
+	long closed;
+	double publishMs; //Thread CPU time in publish()
+	double pollMs;    //And in poll()
+};
+
+class SpectatorServer {
+public:
+	SpectatorServer();
+	~SpectatorServer();
+
+	//Starts listening on port, on every interface
+	bool listen(int port);
+	void close();
+
+	bool active() const {
+		return listener >= 0;
+	}
+
+	//Sends the match as of this tick to every spectator
+	void publish(const GameState &state);
+
+	//Takes new spectators, reads acknowledgements and finishes sends that
+	//did not fit before, waiting up to timeoutMs for any of it
+	void poll(int timeoutMs = 0);
+
+	int spectators() const {
+		return count;
+	}
+
+	SpectateStats stats;
+private:
+	struct Spectator {
+		int fd;           //-1 for a free slot
+		long acked;       //Newest tick it has, -1 for none
+		unsigned char ack[4];
+		int ackSize;      //Bytes of an acknowledgement read so far
+		std::vector<unsigned char> unsent; //Of a message the socket had no room for
+	};
+
+	int listener;
+	int epoll;
+	int count;
+	std::vector<Spectator> slots;
+	std::vector<int> freeSlots;
+
+	Snapshot history[SPECTATE_HISTORY]; //By tick % SPECTATE_HISTORY
+	long historyTick[SPECTATE_HISTORY];
+	unsigned char encoded[SPECTATE_HISTORY][SPECTATE_MESSAGE]; //This tick's message for each base, by ticks back
+	long encodedTick[SPECTATE_HISTORY];
+
+	void accept();
+	void read(Spectator &s);
+	void flush(Spectator &s, int slot);
+	void drop(int slot);
+	const unsigned char* message(long tick, long back);
+
+	SpectatorServer(const SpectatorServer &);
+	void operator=(const SpectatorServer &);
+};
+
+//One spectator's end
+class SpectatorClient {
+public:
+	SpectatorClient();
+	~SpectatorClient();
+
+	//Connects to "host:port"
+	bool connect(const char* address);
+	void close();
+
+	int socket() const {
+		return sock;
+	}
+
+	//Applies whatever snapshots have arrived and acknowledges the newest.
+	//False once the server has gone, or sent a length no message has (the
+	//connection is closed then and the message counted as broken).
+	bool receive();
+
+	Snapshot latest; //Newest snapshot
+	long tick;       //Its tick, -1 before the first
+
+	long messages;
+	long keyframes;
+	long bytes;
+	long broken; //Messages whose base was missing or that did not check out
+private:
+	int sock;
+	unsigned char partial[SPECTATE_MESSAGE];
+	int partialSize;
+	Snapshot history[SPECTATE_HISTORY];
+	long historyTick[SPECTATE_HISTORY];
+	bool resync; //Ask for every field again
+
+	void apply(const unsigned char* message, int size);
+
+	SpectatorClient(const SpectatorClient &);
+	void operator=(const SpectatorClient &);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "statslog.h"
+#include <chrono>
+
+namespace {
+	const char* HEADER = "tick,scorer,score1,score2,xspeed,yspeed,level,stage\n";
+
+	std::string numbered(const std::string &filename, int n) {
+		char suffix[16];
+		sprintf(suffix, ".%d", n);
+		return filename + suffix;
+	}
+}
+
+StatsLog::StatsLog() : echo(false), dropped(0), running(false), file(NULL), maxBytes(0), size(0), reported(0) {
+
+}
+
+StatsLog::~StatsLog() {
+	close();
+}
+
+bool StatsLog::open(const char* filename_, long maxBytes_) {
+	close();
+	filename = filename_;
+	maxBytes = maxBytes_;
+	file = fopen(filename_, "a");
+	if (file == NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	if (size <= 0)
+		size = fprintf(file, "%s", HEADER);
+	reported = dropped;
+	running = true;
+	writer = std::thread(&StatsLog::run, this);
+	return true;
+}
+
+void StatsLog::record(long tick, const PointRecord &point) {
+	StatsRecord record;
+	record.tick = tick;
+	record.point = point;
+	if (!ring.push(record))
+		dropped++;
+}
+
+void StatsLog::close() {
+	if (!writer.joinable())
+		return;
+	running = false;
+	writer.join();
+	if (file != NULL)
+		fclose(file);
+	file = NULL;
+	if (dropped > 0)
+		fprintf(stderr, "Stats log: %ld points dropped in all, missing from %s\n", dropped.load(), filename.c_str());
+}
+
+void StatsLog::run() {
+	while (running) {
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_MS));
+	}
+	drain(); //Whatever came in while asleep
+}
+
+void StatsLog::drain() {
+	StatsRecord record;
+	bool wrote = false;
+	while (ring.pop(record)) {
+		write(record);
+		wrote = true;
+	}
+	if (wrote) {
+		if (file != NULL)
+			fflush(file);
+		if (echo)
+			fflush(stdout);
+	}
+	long lost = dropped;
+	if (lost != reported) {
+		fprintf(stderr, "Stats log: %ld points dropped with the queue full\n", lost - reported);
+		reported = lost;
+	}
+}
+
+void StatsLog::write(const StatsRecord &record) {
+	if (size >= maxBytes)
+		rotate();
+	const PointRecord &p = record.point;
+	if (file != NULL) {
+		int n = fprintf(file, "%ld,%d,%d,%d,%g,%g,%d,%d\n", record.tick, p.scorer, p.score1, p.score2,
+			p.xspeed, p.yspeed, p.level, p.stage);
+		if (n > 0)
+			size += n;
+	}
+	if (echo) {
+		printf("Player ONE :%d -- Player TWO : %d\n", p.score1, p.score2);
+		printf("At speed%g  %g\n", p.xspeed, p.yspeed);
+		printf("At Level %d\n", p.level);
+		printf("In Stage %d\n\n", p.stage);
+	}
+}
+
+//filename becomes filename.1, filename.1 becomes filename.2 and so on, and
+//the oldest is deleted
+void StatsLog::rotate() {
+	fclose(file);
+	remove(numbered(filename, KEEP).c_str());
+	for (int i = KEEP - 1; i >= 1; i--)
+		rename(numbered(filename, i).c_str(), numbered(filename, i + 1).c_str());
+	rename(filename.c_str(), numbered(filename, 1).c_str());
+	file = fopen(filename.c_str(), "w");
+	size = file != NULL ? fprintf(file, "%s", HEADER) : 0;
+}
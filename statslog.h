@@ -0,0 +1,64 @@
+#ifndef STATS_LOG_H
+#define STATS_LOG_H
+
+//Match statistics written by a background thread, so scoring a point never
+//waits on the console or the disk.  The game thread queues one fixed-size
+//record per point without a lock.  The writer thread wakes every FLUSH_MS,
+//appends whatever is queued to a CSV file in one go, and starts a new file
+//once the current one passes maxBytes.  Points dropped because the queue
+//was full are reported on stderr as the writer notices them and again in
+//total on close().  Needs C++11 and -pthread.
+#include "game.h"
+#include "ring.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <stdio.h>
+
+struct StatsRecord {
+	long tick; //Tick the point was scored on
+	PointRecord point;
+};
+
+class StatsLog {
+public:
+	static const int FLUSH_MS = 100;
+	//Full files kept besides the current one, as filename.1 (the newest) up
+	//to filename.KEEP
+	static const int KEEP = 3;
+
+	StatsLog();
+	~StatsLog();
+
+	//Starts the writer, appending to filename
+	bool open(const char* filename, long maxBytes = 1 << 20);
+
+	//Queues a point.  For the game thread only; never blocks, and drops the
+	//point if the writer has fallen a whole queue behind.
+	void record(long tick, const PointRecord &point);
+
+	//Writes out everything queued and stops the writer
+	void close();
+
+	bool echo;    //Also print each point on stdout, from the writer thread
+	std::atomic<long> dropped; //Points lost because the queue was full
+private:
+	Ring<StatsRecord, 1024> ring;
+	std::thread writer;
+	std::atomic<bool> running;
+	FILE* file;
+	std::string filename;
+	long maxBytes;
+	long size; //Of the current file
+	long reported; //Of dropped, already reported by the writer
+
+	void run();
+	void drain();
+	void write(const StatsRecord &record);
+	void rotate();
+
+	StatsLog(const StatsLog &);
+	void operator=(const StatsLog &);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "timing.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+namespace {
+	double clockMs() {
+		return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	const char* KIND_NAMES[TIMING_KINDS] = { "update", "batball", "display", "tick_gap",
+		"key_latency", "mouse_latency", "button_latency" };
+
+	TimingSummary summarize(std::vector<float> &sorted) {
+		TimingSummary s = { 0, 0, 0, 0 };
+		if (sorted.empty())
+			return s;
+		std::sort(sorted.begin(), sorted.end());
+		s.count = (int)sorted.size();
+		s.p50 = sorted[(s.count - 1) / 2];
+		s.p99 = sorted[(s.count - 1) * 99 / 100];
+		s.max = sorted[s.count - 1];
+		return s;
+	}
+}
+
+Timings::Timings() : enabled(false), dropped(0), overwritten(0), historyNext(0), origin(clockMs()) {
+	for (int k = 0; k < TIMING_KINDS; k++)
+		recentNext[k] = 0;
+}
+
+double Timings::now() const {
+	return clockMs() - origin;
+}
+
+void Timings::record(int kind, double start, double end) {
+	TimingSample sample;
+	sample.kind = kind;
+	sample.ms = (float)(end - start);
+	sample.at = start;
+	if (!ring.push(sample))
+		dropped++;
+}
+
+void Timings::drain() {
+	TimingSample sample;
+	while (ring.pop(sample)) {
+		std::vector<float> &window = recent[sample.kind];
+		if ((int)window.size() < WINDOW)
+			window.push_back(sample.ms);
+		else
+			window[recentNext[sample.kind]] = sample.ms;
+		recentNext[sample.kind] = (recentNext[sample.kind] + 1) % WINDOW;
+		if ((int)history.size() < HISTORY)
+			history.push_back(sample);
+		else {
+			history[historyNext] = sample;
+			historyNext = (historyNext + 1) % HISTORY;
+			overwritten++;
+		}
+	}
+}
+
+TimingSummary Timings::summary(int kind) const {
+	std::vector<float> sorted = recent[kind];
+	return summarize(sorted);
+}
+
+TimingSummary Timings::overall(int kind) const {
+	std::vector<float> sorted;
+	for (size_t i = 0; i < history.size(); i++) {
+		if (history[i].kind == kind)
+			sorted.push_back(history[i].ms);
+	}
+	return summarize(sorted);
+}
+
+bool Timings::writeCSV(const char* filename) const {
+	if (history.empty())
+		return true;
+	FILE* output = fopen(filename, "w");
+	if (output == NULL)
+		return false;
+	fprintf(output, "kind,start_ms,duration_ms\n");
+	for (size_t i = 0; i < history.size(); i++) {
+		const TimingSample &s = history[(historyNext + i) % history.size()];
+		fprintf(output, "%s,%.3f,%.4f\n", KIND_NAMES[s.kind], s.at, s.ms);
+	}
+	return fclose(output) == 0;
+}
@@ -0,0 +1,80 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+//Frame and tick timing for the GLUT callbacks.  Needs C++11.
+#include "ring.h"
+#include <stddef.h>
+#include <vector>
+
+//What a sample timed
+enum TimingKind {
+	TIME_UPDATE,   //update()
+	TIME_BATBALL,  //BatBall()
+	TIME_DISPLAY,  //display(), including BatBall() and the swap
+	TIME_TICK_GAP, //From one update() to the next; 25 ms when the timer keeps up
+	//From an input to the end of the first frame presented after it, by
+	//where the input came from
+	TIME_KEY_LATENCY,    //Keyboard
+	TIME_MOUSE_LATENCY,  //Mouse motion (top paddle)
+	TIME_BUTTON_LATENCY, //Mouse buttons (top paddle tilt)
+	TIMING_KINDS
+};
+
+struct TimingSample {
+	int kind;
+	float ms;   //How long it took
+	double at;  //When it started, in ms since the Timings was made
+};
+
+//A full queue drops the sample
+typedef Ring<TimingSample, 4096> TimingRing;
+
+//p50/p99/max of the recent samples of one kind, in ms
+struct TimingSummary {
+	float p50;
+	float p99;
+	float max;
+	int count;
+};
+
+class Timings {
+public:
+	//Samples per kind kept for the overlay
+	static const int WINDOW = 256;
+	//Samples kept for overall() and writeCSV(), about half an hour of play;
+	//older ones are overwritten
+	static const int HISTORY = 1 << 18;
+
+	Timings();
+
+	//ms since the Timings was made, from a monotonic high-resolution clock
+	double now() const;
+
+	//Queues one sample; cheap enough to call from every callback
+	void record(int kind, double start, double end);
+
+	//Moves queued samples into the recent windows and the full history
+	void drain();
+
+	TimingSummary summary(int kind) const;
+
+	//The same over every sample of the kind kept
+	TimingSummary overall(int kind) const;
+
+	//Writes every sample kept as kind,start_ms,duration_ms, oldest first.
+	//Does nothing if there are none.
+	bool writeCSV(const char* filename) const;
+
+	bool enabled;
+	long dropped;     //Samples lost because the queue was full
+	long overwritten; //Samples drained but no longer kept
+private:
+	TimingRing ring;
+	std::vector<float> recent[TIMING_KINDS];
+	int recentNext[TIMING_KINDS];
+	std::vector<TimingSample> history; //A ring once full
+	size_t historyNext; //Where the next sample goes once it is full
+	double origin;
+};
+
+#endif
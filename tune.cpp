@@ -0,0 +1,216 @@
+//Balance tuner.  Plays a set of headless matches on all cores for each
+//combination of GameParams and level values asked for, and reports how the
+//rallies and the scoring come out, so the numbers can be tried without
+//rebuilding and playing by hand.
+//	g++ -O2 -std=c++11 -pthread -o dxball_tune tune.cpp game.cpp runner.cpp level.cpp mappedfile.cpp
+//	dxball_tune [options] name=lo:hi[:steps] | name=value ...
+//		-level file  start from the stages in file (see level.h) instead of the game's own
+//		-random n    n random sets from the ranges instead of the whole grid
+//		-matches n   matches per set (default 200)
+//		-points n    points per match (default 10)
+//		-threads n   worker threads (default one per core)
+//		-seed n      seed of the matches, the same for every set (default 1)
+//e.g.	dxball_tune serveSpeed=.1:.2:5 fanSpeedUp=0:.02:3
+//Prints one CSV line per set: the values swept, then the average rally in
+//ticks, the average level, the scoring asymmetry ((TWO - ONE) / points; 0 is
+//fair), the matches each player won and the matches stopped at the tick
+//limit (see runner.h) because nobody scored.  The names are below.  A value
+//that cannot put the ball in play (a serveSpeed of 0 or less) is refused.
+#include<iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "game.h"
+#include "level.h"
+#include "runner.h"
+using namespace std;
+
+//Sets field of every obstacle of one kind in stage.  Mirrored, a value
+//that is a position keeps the side of the obstacle it is given to.
+void setObstacles(Level &level, int stage, int kind, double LevelObstacle::* field, double value,
+	bool mirrored = false)
+{
+	LevelObstacle* obstacles = level.editObstacles(stage);
+	for (int i = 0; i < level.stage(stage).obstacles; i++) {
+		if (obstacles[i].kind == kind)
+			obstacles[i].*field = mirrored && obstacles[i].*field < 0 ? -value : value;
+	}
+}
+
+void setServeSpeed(GameParams &params, Level &, double v) { params.serveSpeed = v; }
+void setSideSpeed(GameParams &params, Level &, double v) { params.sideSpeed = v; }
+void setFanSpeedUp(GameParams &params, Level &, double v) { params.fanSpeedUp = v; }
+void setSideFanX(GameParams &, Level &level, double v) { setObstacles(level, 1, OBSTACLE_FAN, &LevelObstacle::x, v, true); }
+void setSideFanReach(GameParams &, Level &level, double v) { setObstacles(level, 1, OBSTACLE_FAN, &LevelObstacle::reach, v); }
+void setSideFanHub(GameParams &, Level &level, double v) { setObstacles(level, 1, OBSTACLE_FAN, &LevelObstacle::inner, v); }
+void setMiddleFanReach(GameParams &, Level &level, double v) { setObstacles(level, 2, OBSTACLE_FAN, &LevelObstacle::reach, v); }
+void setMiddleFanHub(GameParams &, Level &level, double v) { setObstacles(level, 2, OBSTACLE_FAN, &LevelObstacle::inner, v); }
+void setBarrierWindow(GameParams &, Level &level, double v) { setObstacles(level, 1, OBSTACLE_BARRIER, &LevelObstacle::inner, v); }
+void setFanTurn(GameParams &, Level &level, double v) { level.editHeader().fanTurn = v; }
+void setBarrierTurn(GameParams &, Level &level, double v) { level.editHeader().barrierTurn = v; }
+
+struct Knob {
+	const char* name;
+	void (*set)(GameParams &params, Level &level, double value);
+	bool positive; //Values of 0 or less are refused
+};
+
+//The speeds are GameParams fields; the rest are in the level: the fans of
+//stage 1 (x mirrored left and right, reach either side of it, hub where
+//they bounce the ball back), the fan of stage 2, the barrier's window in
+//degrees and the turns per tick
+const Knob KNOBS[] = {
+	{ "serveSpeed", setServeSpeed, true }, //The ball never leaves the serve
+	{ "sideSpeed", setSideSpeed, false },
+	{ "fanSpeedUp", setFanSpeedUp, false },
+	{ "sideFanX", setSideFanX, false },
+	{ "sideFanReach", setSideFanReach, false },
+	{ "sideFanHub", setSideFanHub, false },
+	{ "middleFanReach", setMiddleFanReach, false },
+	{ "middleFanHub", setMiddleFanHub, false },
+	{ "barrierWindow", setBarrierWindow, false },
+	{ "fanTurn", setFanTurn, false },
+	{ "barrierTurn", setBarrierTurn, false },
+};
+const int KNOB_COUNT = sizeof(KNOBS) / sizeof(KNOBS[0]);
+
+//One parameter being swept
+struct Range {
+	int knob;
+	double lo;
+	double hi;
+	int steps; //Grid points from lo to hi inclusive
+
+	double at(int step) const {
+		return steps > 1 ? lo + (hi - lo) * step / (steps - 1) : lo;
+	}
+};
+
+//Reads name=lo:hi[:steps] or name=value
+bool parseRange(const char* arg, Range &range)
+{
+	const char* equals = strchr(arg, '=');
+	if (equals == NULL)
+		return false;
+	range.knob = -1;
+	for (int k = 0; k < KNOB_COUNT; k++) {
+		if (strlen(KNOBS[k].name) == (size_t)(equals - arg) && strncmp(arg, KNOBS[k].name, equals - arg) == 0)
+			range.knob = k;
+	}
+	if (range.knob < 0)
+		return false;
+	char* end;
+	range.lo = strtod(equals + 1, &end);
+	range.hi = range.lo;
+	range.steps = 1;
+	if (*end == ':') {
+		range.hi = strtod(end + 1, &end);
+		range.steps = 5;
+		if (*end == ':')
+			range.steps = (int)strtol(end + 1, &end, 10);
+	}
+	if (*end != 0 || range.steps < 1)
+		return false;
+	if (KNOBS[range.knob].positive && (range.lo <= 0 || range.hi <= 0)) {
+		cerr << KNOBS[range.knob].name << " must be above 0\n";
+		return false;
+	}
+	return true;
+}
+
+//Plays one set, the values of the ranges applied to params and level, and
+//prints its line
+void evaluate(GameParams &params, Level &level, const vector<Range> &ranges, const vector<double> &values,
+	long matches, int points, int threads, unsigned int seed)
+{
+	for (size_t i = 0; i < ranges.size(); i++)
+		KNOBS[ranges[i].knob].set(params, level, values[i]);
+	RunStats stats = runMatches(matches, points, threads, seed, &params);
+	long played = stats.score1 + stats.score2;
+	for (size_t i = 0; i < values.size(); i++)
+		cout << values[i] << ",";
+	cout << (played > 0 ? (double)stats.rallyTicks / played : 0) << ","
+		<< (played > 0 ? (double)stats.levelTotal / played : 0) << ","
+		<< (played > 0 ? (double)(stats.score2 - stats.score1) / played : 0) << ","
+		<< stats.wins1 << "," << stats.wins2 << "," << stats.capped << "\n";
+}
+
+int main(int argc, char** argv)
+{
+	long matches = 200;
+	int points = 10;
+	int threads = 0;
+	unsigned int seed = 1;
+	long samples = 0;
+	const char* levelFile = NULL;
+	vector<Range> ranges;
+	for (int i = 1; i < argc; i++) {
+		Range range;
+		if (strcmp(argv[i], "-level") == 0 && i + 1 < argc)
+			levelFile = argv[++i];
+		else if (strcmp(argv[i], "-random") == 0 && i + 1 < argc)
+			samples = atol(argv[++i]);
+		else if (strcmp(argv[i], "-matches") == 0 && i + 1 < argc)
+			matches = atol(argv[++i]);
+		else if (strcmp(argv[i], "-points") == 0 && i + 1 < argc)
+			points = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+			seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		else if (parseRange(argv[i], range))
+			ranges.push_back(range);
+		else {
+			cerr << "usage: dxball_tune [-level file] [-random n] [-matches n] [-points n] [-threads n] [-seed n]"
+				" name=lo:hi[:steps] | name=value ...\nnames:";
+			for (int k = 0; k < KNOB_COUNT; k++)
+				cerr << " " << KNOBS[k].name;
+			cerr << "\n";
+			return 1;
+		}
+	}
+	if (matches <= 0 || points <= 0) {
+		cerr << "Need at least one match of one point\n";
+		return 1;
+	}
+
+	for (size_t i = 0; i < ranges.size(); i++)
+		cout << KNOBS[ranges[i].knob].name << ",";
+	cout << "rally,level,asymmetry,wins1,wins2,capped\n";
+
+	Level level(Level::builtIn());
+	if (levelFile != NULL && !level.load(levelFile)) {
+		cerr << "Could not read level " << levelFile << "\n";
+		return 1;
+	}
+	GameParams params;
+	params.level = &level;
+	vector<double> values(ranges.size());
+	if (samples > 0) {
+		//Uniform over each range, from a stream of its own so a run can be repeated
+		unsigned int r = seed;
+		for (long n = 0; n < samples; n++) {
+			for (size_t i = 0; i < ranges.size(); i++) {
+				r = matchSeed(r, n);
+				double u = (r >> 8) / 16777216.0;
+				values[i] = ranges[i].lo + (ranges[i].hi - ranges[i].lo) * u;
+			}
+			evaluate(params, level, ranges, values, matches, points, threads, seed);
+		}
+		return 0;
+	}
+
+	//Every combination, the last range changing fastest
+	vector<int> step(ranges.size(), 0);
+	for (;;) {
+		for (size_t i = 0; i < ranges.size(); i++)
+			values[i] = ranges[i].at(step[i]);
+		evaluate(params, level, ranges, values, matches, points, threads, seed);
+		int i = (int)ranges.size() - 1;
+		while (i >= 0 && ++step[i] == ranges[i].steps)
+			step[i--] = 0;
+		if (i < 0)
+			break;
+	}
+	return 0;
+}